@@ -3,10 +3,18 @@
     'target_name': 'sharp',
     'sources': [
       'src/common.cc',
+      'src/convolve.cc',
+      'src/header.cc',
+      'src/intermediates.cc',
       'src/utilities.cc',
       'src/metadata.cc',
+      'src/metrics.cc',
+      'src/outputcache.cc',
+      'src/pool.cc',
       'src/resize.cc',
-      'src/sharp.cc'
+      'src/resources.cc',
+      'src/sharp.cc',
+      'src/smartcrop.cc'
     ],
     'conditions': [
         ['OS=="win"', {
@@ -2,6 +2,7 @@
 
 var path = require('path');
 var util = require('util');
+var net = require('net');
 var stream = require('stream');
 var events = require('events');
 
@@ -18,6 +19,14 @@ var maximum = {
   pixels: Math.pow(0x3FFF, 2)
 };
 
+// Range of streamed input lengths, doubling, at which to attempt to read its header
+var sniff = {
+  min: 1024,
+  max: 1048576,
+  // Formats whose dimensions can be read from a partial header
+  formats: ['jpeg', 'png', 'webp', 'tiff']
+};
+
 var Sharp = function(input) {
   if (!(this instanceof Sharp)) {
     return new Sharp(input);
@@ -26,9 +35,16 @@ var Sharp = function(input) {
   this.options = {
     // input options
     bufferIn: null,
+    bufferInLength: 0,
     streamIn: false,
+    sniffLength: sniff.min,
     sequentialRead: false,
+    copyInput: false,
     limitInputPixels: maximum.pixels,
+    // scheduling options
+    priority: 'normal',
+    timeout: 0,
+    timings: false,
     // ICC profiles
     iccProfilePath: path.join(__dirname, 'icc') + path.sep,
     // resize options
@@ -60,6 +76,8 @@ var Sharp = function(input) {
     gamma: 0,
     greyscale: false,
     normalize: 0,
+    normalizeLower: 0,
+    normalizeUpper: 100,
     // output options
     output: '__input',
     progressive: false,
@@ -74,6 +92,15 @@ var Sharp = function(input) {
     withMetadata: false,
     tileSize: 256,
     tileOverlap: 0,
+    tileLevel: -1,
+    tileColumn: -1,
+    tileRow: -1,
+    tiffTile: false,
+    tiffTileSize: 256,
+    tiffPyramid: false,
+    tiffCompression: 'jpeg',
+    tiffPredictor: 'none',
+    renditions: null,
     // Function to notify of queue length changes
     queueListener: function(queueLength) {
       module.exports.queue.emit('change', queueLength);
@@ -86,8 +113,9 @@ var Sharp = function(input) {
     // input=buffer
     this.options.bufferIn = input;
   } else {
-    // input=stream
+    // input=stream, collected as an Array of chunks
     this.options.streamIn = true;
+    this.options.bufferIn = [];
   }
   return this;
 };
@@ -110,33 +138,70 @@ module.exports.format = sharp.format();
 Sharp.prototype._write = function(chunk, encoding, callback) {
   /*jslint unused: false */
   if (this.options.streamIn) {
+    var err = null;
     if (typeof chunk === 'object' && chunk instanceof Buffer) {
-      if (this.options.bufferIn instanceof Buffer) {
-        // Append to existing Buffer
-        this.options.bufferIn = Buffer.concat(
-          [this.options.bufferIn, chunk],
-          this.options.bufferIn.length + chunk.length
-        );
-      } else {
-        // Create new Buffer
-        this.options.bufferIn = new Buffer(chunk.length);
-        chunk.copy(this.options.bufferIn);
-      }
-      callback();
+      // Append to list of chunks, joined once processing starts
+      this.options.bufferIn.push(chunk);
+      this.options.bufferInLength = this.options.bufferInLength + chunk.length;
+      err = this._sniff();
     } else {
-      callback(new Error('Non-Buffer data on Writable Stream'));
+      err = new Error('Non-Buffer data on Writable Stream');
     }
+    callback(err);
   } else {
     callback(new Error('Unexpected data on Writable Stream'));
   }
 };
 
+/*
+  Attempt to read the header of partial streamed input, doubling the length required for each attempt
+  Returns an Error if the input exceeds the pixel limit
+  Other formats, which only libvips can identify, are checked once processing starts
+*/
+Sharp.prototype._sniff = function() {
+  if (this.options.sniffLength > 0 && this.options.bufferInLength >= this.options.sniffLength) {
+    var header = sharp.sniff(Buffer.concat(this.options.bufferIn, this.options.bufferInLength));
+    if (header.width * header.height > this.options.limitInputPixels) {
+      return new Error('Input image exceeds pixel limit');
+    }
+    if (header.width > 0 || sniff.formats.indexOf(header.format) === -1 || this.options.sniffLength >= sniff.max) {
+      // Header complete, of a format whose dimensions are only known once processed, or too far into input to read again
+      this.options.sniffLength = 0;
+    } else {
+      this.options.sniffLength = Math.max(this.options.sniffLength, this.options.bufferInLength) * 2;
+    }
+  }
+  return null;
+};
+
+/*
+  Call fn with the options once all input has been written to the Writable Stream,
+  or call back with an Error if the input was rejected before then
+*/
+Sharp.prototype._whenWritten = function(fn, callback) {
+  var that = this;
+  var onError = function(err) {
+    that.removeListener('finish', onFinish);
+    callback(err);
+  };
+  var onFinish = function() {
+    that.removeListener('error', onError);
+    fn(that.options, callback);
+  };
+  this.once('error', onError);
+  this.once('finish', onFinish);
+};
+
 // Crop this part of the resized image (Center/Centre, North, East, South, West)
 module.exports.gravity = {'center': 0, 'centre': 0, 'north': 1, 'east': 2, 'south': 3, 'west': 4};
 
+// Crop the part of the resized image chosen by its content
+module.exports.strategy = {'entropy': 16, 'attention': 17};
+
 Sharp.prototype.crop = function(gravity) {
   this.options.canvas = 'crop';
-  if (typeof gravity === 'number' && !Number.isNaN(gravity) && gravity >= 0 && gravity <= 4) {
+  var isStrategy = gravity === module.exports.strategy.entropy || gravity === module.exports.strategy.attention;
+  if (typeof gravity === 'number' && !Number.isNaN(gravity) && ((gravity >= 0 && gravity <= 4) || isStrategy)) {
     this.options.gravity = gravity;
   } else {
     throw new Error('Unsupported crop gravity ' + gravity);
@@ -146,7 +211,7 @@ Sharp.prototype.crop = function(gravity) {
 
 Sharp.prototype.extract = function(topOffset, leftOffset, width, height) {
   /*jslint unused: false */
-  var suffix = this.options.width === -1 && this.options.height === -1 ? 'Pre' : 'Post';
+  var suffix = this.options.width === -1 && this.options.height === -1 && this.options.tileLevel === -1 ? 'Pre' : 'Post';
   var values = arguments;
   ['topOffset', 'leftOffset', 'width', 'height'].forEach(function(name, index) {
     if (typeof values[index] === 'number' && !Number.isNaN(values[index]) && (values[index] % 1 === 0) && values[index] >= 0) {
@@ -350,10 +415,24 @@ Sharp.prototype.gamma = function(gamma) {
 
 /*
   Enhance output image contrast by stretching its luminance to cover the full dynamic range
+  Optionally clip the darkest and brightest pixels, given as lower and upper percentiles
 */
-Sharp.prototype.normalize = function(normalize) {
+Sharp.prototype.normalize = function(normalize, upper) {
   if (process.platform !== 'win32') {
-    this.options.normalize = (typeof normalize === 'boolean') ? normalize : true;
+    if (typeof normalize === 'number') {
+      upper = (typeof upper === 'number') ? upper : 100;
+      if (!Number.isNaN(normalize) && normalize >= 0 && upper > normalize && upper <= 100) {
+        this.options.normalize = true;
+        this.options.normalizeLower = normalize;
+        this.options.normalizeUpper = upper;
+      } else {
+        throw new Error('Invalid normalisation percentiles (0 to 100) ' + normalize + ', ' + upper);
+      }
+    } else {
+      this.options.normalize = (typeof normalize === 'boolean') ? normalize : true;
+      this.options.normalizeLower = 0;
+      this.options.normalizeUpper = 100;
+    }
   } else {
     console.error('normalize unavailable on win32 platform');
   }
@@ -380,6 +459,58 @@ Sharp.prototype.sequentialRead = function(sequentialRead) {
   return this;
 };
 
+/*
+  Set the priority class of this task within the native worker pool's queue: high, normal or low
+*/
+Sharp.prototype.priority = function(priority) {
+  if (priority === 'high' || priority === 'normal' || priority === 'low') {
+    this.options.priority = priority;
+  } else {
+    throw new Error('Invalid priority ' + priority);
+  }
+  return this;
+};
+
+/*
+  Abort processing, with an Error whose code is ETIMEDOUT, when not complete within this many milliseconds of starting,
+  including any time spent queued. A value of 0 disables the timeout.
+*/
+Sharp.prototype.timeout = function(timeout) {
+  if (typeof timeout === 'number' && !Number.isNaN(timeout) && timeout % 1 === 0 && timeout >= 0) {
+    this.options.timeout = timeout;
+  } else {
+    throw new Error('Invalid timeout ' + timeout);
+  }
+  return this;
+};
+
+/*
+  Abort the most recently started processing, with an Error whose code is ECANCELED
+*/
+Sharp.prototype.cancel = function() {
+  if (typeof this.options.taskId === 'number') {
+    sharp.cancel(this.options.taskId);
+  }
+  return this;
+};
+
+/*
+  Report the time taken by each stage of processing, and the scaling chosen, as a timings Object in info
+*/
+Sharp.prototype.timings = function(timings) {
+  this.options.timings = (typeof timings === 'boolean') ? timings : true;
+  return this;
+};
+
+/*
+  Take a copy of input Buffer data, leaving the caller free to modify it while processing
+  The default behaviour is to read the input Buffer in place
+*/
+Sharp.prototype.copyInput = function(copyInput) {
+  this.options.copyInput = (typeof copyInput === 'boolean') ? copyInput : true;
+  return this;
+};
+
 Sharp.prototype.quality = function(quality) {
   if (!Number.isNaN(quality) && quality >= 1 && quality <= 100) {
     this.options.quality = quality;
@@ -471,7 +602,7 @@ Sharp.prototype.withMetadata = function(withMetadata) {
 };
 
 /*
-  Tile size and overlap for Deep Zoom output
+  Tile size and overlap for Deep Zoom output, written to a directory of tiles or, via a .zip file or dz(), a zip container
 */
 Sharp.prototype.tile = function(size, overlap) {
   // Size of square tiles, in pixels
@@ -558,13 +689,114 @@ Sharp.prototype.toFile = function(output, callback) {
   return this;
 };
 
+/*
+  The Error for an output format that the installed libvips cannot write to a Buffer or Stream, if any
+*/
+var bufferOutputError = function(output) {
+  if (output === '__tiff' && !module.exports.format.tiff.output.buffer) {
+    return new Error('TIFF output to a Buffer or Stream requires libvips 8.5.0+');
+  }
+  return null;
+};
+
 /*
   Write output to a Buffer
 */
 Sharp.prototype.toBuffer = function(callback) {
+  var errOutput = bufferOutputError(this.options.output);
+  if (errOutput) {
+    if (typeof callback === 'function') {
+      callback(errOutput);
+      return this;
+    }
+    return BluebirdPromise.reject(errOutput);
+  }
   return this._sharp(callback);
 };
 
+/*
+  Canvas methods that can be named by a rendition
+*/
+var renditionCanvas = ['crop', 'embed', 'max', 'min', 'ignoreAspectRatio'];
+
+/*
+  Convert a rendition spec to its output options, validated via the usual methods
+*/
+var rendition = function(options, spec) {
+  var that = Object.create(Sharp.prototype);
+  that.options = {
+    width: -1,
+    height: -1,
+    canvas: options.canvas,
+    gravity: options.gravity,
+    withoutEnlargement: options.withoutEnlargement,
+    output: options.output,
+    quality: options.quality,
+    progressive: options.progressive,
+    compressionLevel: options.compressionLevel
+  };
+  that.resize(spec.width, spec.height);
+  if (typeof spec.canvas !== 'undefined') {
+    if (renditionCanvas.indexOf(spec.canvas) === -1) {
+      throw new Error('Unsupported canvas ' + spec.canvas);
+    }
+    that[spec.canvas]();
+  }
+  if (typeof spec.gravity !== 'undefined') {
+    that.crop(spec.gravity);
+  }
+  ['withoutEnlargement', 'progressive', 'quality', 'compressionLevel'].forEach(function(name) {
+    if (typeof spec[name] !== 'undefined') {
+      that[name](spec[name]);
+    }
+  });
+  if (typeof spec.format !== 'undefined') {
+    that.toFormat(spec.format);
+  }
+  if (that.options.output === '__tiff' || that.options.output === '__dz') {
+    throw new Error('Unsupported rendition format ' + (spec.format || that.options.output.slice(2)));
+  }
+  return that.options;
+};
+
+/*
+  Write many renditions of the same input to Buffers, decoding it only once
+  @param renditions is an Array of Objects with optional attributes
+    width, height, canvas, gravity, withoutEnlargement, format, quality, progressive, compressionLevel
+*/
+Sharp.prototype.toBuffers = function(renditions, callback) {
+  if (!Array.isArray(renditions) || renditions.length === 0) {
+    throw new Error('Invalid renditions ' + renditions);
+  }
+  this.options.renditions = renditions.map(function(spec) {
+    return rendition(this.options, spec);
+  }, this);
+  return this._sharp(callback);
+};
+
+/*
+  Render a single Deep Zoom tile, as generated by tile() with the same size and overlap, reading only the input under it
+  @param level, column and row are integral Numbers addressing the tile, where level 0 is the 1x1 pixel image
+*/
+Sharp.prototype.extractTile = function(level, column, row) {
+  var values = arguments;
+  ['tileLevel', 'tileColumn', 'tileRow'].forEach(function(name, index) {
+    if (typeof values[index] === 'number' && !Number.isNaN(values[index]) && (values[index] % 1 === 0) && values[index] >= 0) {
+      this.options[name] = values[index];
+    } else {
+      throw new Error('Non-integer value for ' + name + ' of ' + values[index]);
+    }
+  }.bind(this));
+  if (this.options.topOffsetPre !== -1) {
+    throw new Error('Tile extraction cannot follow a pre-resize extract');
+  }
+  // Ensure existing rotation occurs before the tile is located
+  if (this.options.angle !== 0) {
+    this.options.rotateBeforePreExtract = true;
+  }
+  return this;
+};
+
 /*
   Force JPEG output
 */
@@ -589,6 +821,48 @@ Sharp.prototype.webp = function() {
   return this;
 };
 
+/*
+  Force TIFF output
+  @param options is an optional Object with attributes tile, tileSize, pyramid, compression and predictor
+*/
+Sharp.prototype.tiff = function(options) {
+  if (typeof options === 'object' && options !== null) {
+    // Tiled layout and multi-resolution pyramid, the latter implying the former
+    ['tile', 'pyramid'].forEach(function(name) {
+      if (typeof options[name] !== 'undefined') {
+        if (typeof options[name] !== 'boolean') {
+          throw new Error('Invalid TIFF ' + name + ' ' + options[name]);
+        }
+        this.options['tiff' + name.charAt(0).toUpperCase() + name.slice(1)] = options[name];
+      }
+    }, this);
+    // Size of square tiles, in pixels, as a multiple of 16
+    if (typeof options.tileSize !== 'undefined') {
+      if (typeof options.tileSize === 'number' && options.tileSize % 16 === 0 && options.tileSize >= 16 && options.tileSize <= 8192) {
+        this.options.tiffTileSize = options.tileSize;
+      } else {
+        throw new Error('Invalid TIFF tileSize (multiple of 16 from 16 to 8192) ' + options.tileSize);
+      }
+    }
+    if (typeof options.compression !== 'undefined') {
+      if (['jpeg', 'deflate', 'lzw', 'none'].indexOf(options.compression) !== -1) {
+        this.options.tiffCompression = options.compression;
+      } else {
+        throw new Error('Invalid TIFF compression (jpeg, deflate, lzw or none) ' + options.compression);
+      }
+    }
+    if (typeof options.predictor !== 'undefined') {
+      if (['none', 'horizontal', 'float'].indexOf(options.predictor) !== -1) {
+        this.options.tiffPredictor = options.predictor;
+      } else {
+        throw new Error('Invalid TIFF predictor (none, horizontal or float) ' + options.predictor);
+      }
+    }
+  }
+  this.options.output = '__tiff';
+  return this;
+};
+
 /*
   Force raw, uint8 output
 */
@@ -602,6 +876,18 @@ Sharp.prototype.raw = function() {
   return this;
 };
 
+/*
+  Force Deep Zoom output, with all tiles in a single zip container
+*/
+Sharp.prototype.dz = function() {
+  if (module.exports.format.dz.output.buffer) {
+    this.options.output = '__dz';
+  } else {
+    console.error('Deep Zoom output to a Buffer or Stream requires libvips 8.0.0+');
+  }
+  return this;
+};
+
 /*
   Force output to a given format
   @param format is either the id as a String or an Object with an 'id' attribute
@@ -625,7 +911,57 @@ Sharp.prototype.toFormat = function(format) {
 Sharp.prototype._read = function() {
   if (!this.options.streamOut) {
     this.options.streamOut = true;
-    this._sharp();
+    var errOutput = bufferOutputError(this.options.output);
+    if (errOutput) {
+      this.emit('error', errOutput);
+      this.push(null);
+    } else {
+      this._sharp();
+    }
+  } else if (this._streamOutPipe) {
+    // The consumer wants more, so resume reading encoded data from the pipe
+    this._streamOutPipe.resume();
+  }
+};
+
+/*
+  Invoke the C++ image processing pipeline with output to this Readable Stream
+  JPEG, PNG and WebP output is read from a pipe as the encoder writes it, other formats arrive in one Buffer
+*/
+Sharp.prototype._streamOut = function() {
+  var that = this;
+  var pending = 1;
+  var done = function() {
+    pending--;
+    if (pending === 0) {
+      that.push(null);
+    }
+  };
+  var fd = sharp.resize(this.options, function(err, data) {
+    if (err) {
+      var error = new Error(err);
+      error.code = err.code;
+      that.emit('error', error);
+    } else if (data instanceof Buffer) {
+      that.push(data);
+    }
+    done();
+  });
+  if (typeof fd === 'number') {
+    // The pipe holds a bounded amount of encoded data, which is read only while the consumer keeps up,
+    // so a slow consumer blocks the encoder rather than buffering the whole image
+    pending++;
+    var pipe = new net.Socket({fd: fd, readable: true, writable: false});
+    this._streamOutPipe = pipe;
+    pipe.on('data', function(chunk) {
+      if (!that.push(chunk)) {
+        pipe.pause();
+      }
+    });
+    pipe.on('error', function(err) {
+      that.emit('error', err);
+    });
+    pipe.on('close', done);
   }
 };
 
@@ -639,9 +975,7 @@ Sharp.prototype._sharp = function(callback) {
     // output=file/buffer
     if (this.options.streamIn) {
       // output=file/buffer, input=stream
-      this.on('finish', function() {
-        sharp.resize(that.options, callback);
-      });
+      this._whenWritten(sharp.resize, callback);
     } else {
       // output=file/buffer, input=file/buffer
       sharp.resize(this.options, callback);
@@ -651,26 +985,15 @@ Sharp.prototype._sharp = function(callback) {
     // output=stream
     if (this.options.streamIn) {
       // output=stream, input=stream
-      this.on('finish', function() {
-        sharp.resize(that.options, function(err, data) {
-          if (err) {
-            that.emit('error', new Error(err));
-          } else {
-            that.push(data);
-          }
-          that.push(null);
-        });
+      this._whenWritten(function() {
+        that._streamOut();
+      }, function() {
+        // Input rejected part way through will have already emitted its error
+        that.push(null);
       });
     } else {
       // output=stream, input=file/buffer
-      sharp.resize(this.options, function(err, data) {
-        if (err) {
-          that.emit('error', new Error(err));
-        } else {
-          that.push(data);
-        }
-        that.push(null);
-      });
+      this._streamOut();
     }
     return this;
   } else {
@@ -678,14 +1001,12 @@ Sharp.prototype._sharp = function(callback) {
     if (this.options.streamIn) {
       // output=promise, input=stream
       return new BluebirdPromise(function(resolve, reject) {
-        that.on('finish', function() {
-          sharp.resize(that.options, function(err, data) {
-            if (err) {
-              reject(err);
-            } else {
-              resolve(data);
-            }
-          });
+        that._whenWritten(sharp.resize, function(err, data) {
+          if (err) {
+            reject(err);
+          } else {
+            resolve(data);
+          }
         });
       });
     } else {
@@ -711,9 +1032,7 @@ Sharp.prototype.metadata = function(callback) {
   var that = this;
   if (typeof callback === 'function') {
     if (this.options.streamIn) {
-      this.on('finish', function() {
-        sharp.metadata(that.options, callback);
-      });
+      this._whenWritten(sharp.metadata, callback);
     } else {
       sharp.metadata(this.options, callback);
     }
@@ -721,14 +1040,12 @@ Sharp.prototype.metadata = function(callback) {
   } else {
     if (this.options.streamIn) {
       return new BluebirdPromise(function(resolve, reject) {
-        that.on('finish', function() {
-          sharp.metadata(that.options, function(err, data) {
-            if (err) {
-              reject(err);
-            } else {
-              resolve(data);
-            }
-          });
+        that._whenWritten(sharp.metadata, function(err, data) {
+          if (err) {
+            reject(err);
+          } else {
+            resolve(data);
+          }
         });
       });
     } else {
@@ -746,16 +1063,174 @@ Sharp.prototype.metadata = function(callback) {
 };
 
 /*
-  Get and set cache memory and item limits
+  Read the metadata of many images, each a filename or Buffer, in one task spread across threads
+  Supports callback and promise variants, both providing an Array holding the metadata or Error of each input
 */
-module.exports.cache = function(memory, items) {
+module.exports.metadataBatch = function(inputs, callback) {
+  if (!Array.isArray(inputs)) {
+    throw new Error('Invalid inputs ' + inputs);
+  }
+  var options = inputs.map(function(input) {
+    if (typeof input === 'string') {
+      return {fileIn: input};
+    } else if (typeof input === 'object' && input instanceof Buffer) {
+      if (input.length === 0) {
+        throw new Error('Buffer is empty');
+      }
+      return {bufferIn: input};
+    } else {
+      throw new Error('Unsupported input ' + typeof input);
+    }
+  });
+  if (typeof callback === 'function') {
+    sharp.metadataBatch(options, callback);
+  } else {
+    return new BluebirdPromise(function(resolve, reject) {
+      sharp.metadataBatch(options, function(err, data) {
+        if (err) {
+          reject(err);
+        } else {
+          resolve(data);
+        }
+      });
+    });
+  }
+};
+
+/*
+  Methods that can be named as operations of a pipeline, each setting options of the template it compiles
+*/
+var pipelineOperations = [
+  'resize', 'extract', 'crop', 'embed', 'max', 'min', 'ignoreAspectRatio', 'background', 'flatten', 'rotate',
+  'flip', 'flop', 'withoutEnlargement', 'blur', 'sharpen', 'interpolateWith', 'gamma', 'normalize', 'normalise',
+  'greyscale', 'grayscale', 'sequentialRead', 'priority', 'timeout', 'timings', 'copyInput', 'limitInputPixels',
+  'jpeg', 'png', 'webp', 'tiff', 'raw', 'toFormat', 'quality', 'progressive', 'compressionLevel', 'withoutAdaptiveFiltering',
+  'withoutChromaSubsampling', 'trellisQuantisation', 'trellisQuantization', 'overshootDeringing', 'optimiseScans',
+  'optimizeScans', 'withMetadata'
+];
+
+/*
+  A pipeline compiles its operations, validated via the usual methods, once into a native template
+  @param operations is an Object whose attributes name methods, applied in order, and whose values are their
+    argument, an Array of arguments, or true for none
+*/
+var Pipeline = function(operations) {
+  if (typeof operations !== 'object' || operations === null) {
+    throw new Error('Invalid pipeline operations ' + operations);
+  }
+  var template = new Sharp();
+  Object.keys(operations).forEach(function(name) {
+    if (pipelineOperations.indexOf(name) === -1) {
+      throw new Error('Unsupported pipeline operation ' + name);
+    }
+    var value = operations[name];
+    if (value === true) {
+      template[name]();
+    } else if (Array.isArray(value)) {
+      template[name].apply(template, value);
+    } else {
+      template[name](value);
+    }
+  });
+  this.id = sharp.pipeline(template.options);
+  this.taskId = null;
+};
+
+/*
+  Process an input, a filename or Buffer, with the native template
+*/
+Pipeline.prototype._run = function(input, output, callback) {
+  if (this.id === null) {
+    throw new Error('Pipeline has been released');
+  }
+  if (typeof input === 'object' && input instanceof Buffer) {
+    if (input.length === 0) {
+      throw new Error('Buffer is empty');
+    }
+  } else if (typeof input !== 'string') {
+    throw new Error('Unsupported input ' + typeof input);
+  }
+  if (typeof callback === 'function') {
+    this.taskId = sharp.pipelineResize(this.id, input, output, callback);
+    return this;
+  } else {
+    var that = this;
+    return new BluebirdPromise(function(resolve, reject) {
+      that.taskId = sharp.pipelineResize(that.id, input, output, function(err, data) {
+        if (err) {
+          reject(err);
+        } else {
+          resolve(data);
+        }
+      });
+    });
+  }
+};
+
+/*
+  Write output to a Buffer
+*/
+Pipeline.prototype.toBuffer = function(input, callback) {
+  return this._run(input, '', callback);
+};
+
+/*
+  Write output image data to a file
+*/
+Pipeline.prototype.toFile = function(input, output, callback) {
+  if (typeof output !== 'string' || output.length === 0) {
+    throw new Error('Invalid output');
+  }
+  if (input === output) {
+    throw new Error('Cannot use same file for input and output');
+  }
+  return this._run(input, output, callback);
+};
+
+/*
+  Abort the most recently started processing of this pipeline, with an Error whose code is ECANCELED
+*/
+Pipeline.prototype.cancel = function() {
+  if (typeof this.taskId === 'number') {
+    sharp.cancel(this.taskId);
+  }
+  return this;
+};
+
+/*
+  Free the native template, after which the pipeline can no longer be used
+*/
+Pipeline.prototype.release = function() {
+  if (this.id !== null) {
+    sharp.pipelineRelease(this.id);
+    this.id = null;
+  }
+};
+
+/*
+  Compile operations into a reusable pipeline
+*/
+module.exports.pipeline = function(operations) {
+  return new Pipeline(operations);
+};
+
+/*
+  Get and set cache memory and item limits, and the memory limits of the intermediate and output image caches
+*/
+module.exports.cache = function(memory, items, intermediates, outputs) {
   if (typeof memory !== 'number' || Number.isNaN(memory)) {
     memory = null;
   }
   if (typeof items !== 'number' || Number.isNaN(items)) {
     items = null;
   }
-  return sharp.cache(memory, items);
+  if (typeof intermediates !== 'number' || Number.isNaN(intermediates)) {
+    intermediates = null;
+  }
+  if (typeof outputs !== 'number' || Number.isNaN(outputs)) {
+    outputs = null;
+  }
+  return sharp.cache(memory, items, intermediates, outputs);
 };
 
 /*
@@ -768,6 +1243,42 @@ module.exports.concurrency = function(concurrency) {
   return sharp.concurrency(concurrency);
 };
 
+/*
+  Enable or disable SIMD convolution, returning the instruction set in use
+*/
+module.exports.simd = function(enable) {
+  if (typeof enable !== 'boolean') {
+    enable = null;
+  }
+  return sharp.simd(enable);
+};
+
+/*
+  Get and set the number of threads in the native worker pool, and whether it orders tasks shortest job first
+*/
+module.exports.pool = function(threads, shortestJobFirst) {
+  if (typeof threads !== 'number' || Number.isNaN(threads)) {
+    threads = null;
+  }
+  if (typeof shortestJobFirst !== 'boolean') {
+    shortestJobFirst = null;
+  }
+  return sharp.pool(threads, shortestJobFirst);
+};
+
+/*
+  Get and set admission control limits: the memory budget (MB) of processing tasks and the maximum queue length
+*/
+module.exports.admission = function(memory, queue) {
+  if (typeof memory !== 'number' || Number.isNaN(memory)) {
+    memory = null;
+  }
+  if (typeof queue !== 'number' || Number.isNaN(queue)) {
+    queue = null;
+  }
+  return sharp.admission(memory, queue);
+};
+
 /*
   Get internal counters
 */
@@ -775,6 +1286,13 @@ module.exports.counters = function() {
   return sharp.counters();
 };
 
+/*
+  Get process-wide metrics of resize tasks, optionally resetting them
+*/
+module.exports.metrics = function(reset) {
+  return sharp.metrics(reset === true);
+};
+
 /*
   Get the version of the libvips library
 */
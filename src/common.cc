@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <string>
 #include <string.h>
 #include <vips/vips.h>
 
 #include "common.h"
+#include "resources.h"
 
 namespace sharp {
 
@@ -12,6 +16,9 @@ namespace sharp {
   // How many tasks are being processed?
   volatile int counterProcess = 0;
 
+  // How many tasks have been rejected by a full queue?
+  volatile int counterRejected = 0;
+
   // Filename extension checkers
   static bool EndsWith(std::string const &str, std::string const &end) {
     return str.length() >= end.length() && 0 == str.compare(str.length() - end.length(), end.length(), end);
@@ -31,6 +38,9 @@ namespace sharp {
   bool IsDz(std::string const &str) {
     return EndsWith(str, ".dzi") || EndsWith(str, ".DZI");
   }
+  bool IsDzZip(std::string const &str) {
+    return EndsWith(str, ".zip") || EndsWith(str, ".ZIP");
+  }
 
   /*
     Determine image format of a buffer.
@@ -55,6 +65,53 @@ namespace sharp {
     return imageType;
   }
 
+  /*
+    Join chunks of data, for example from a Stream, into a single newly-allocated char[] buffer.
+  */
+  char* JoinChunks(std::vector<std::pair<char*, size_t>> const &chunks, size_t const length) {
+    char *buffer = new char[length];
+    size_t offset = 0;
+    for (auto const &chunk : chunks) {
+      memcpy(buffer + offset, chunk.first, chunk.second);
+      offset += chunk.second;
+    }
+    return buffer;
+  }
+
+  static inline uint64_t RotateLeft(uint64_t const value, int const bits) {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  /*
+    Fast, non-cryptographic 64-bit hash of data, for identifying repeated inputs within this process.
+    Mixes 8 bytes at a time in the manner of MurmurHash3.
+  */
+  uint64_t HashData(void const *data, size_t const length) {
+    uint64_t const c1 = 0x87c37b91114253d5ULL;
+    uint64_t const c2 = 0x4cf5ad432745937fULL;
+    unsigned char const *bytes = static_cast<unsigned char const*>(data);
+    uint64_t hash = length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+      uint64_t word;
+      memcpy(&word, bytes + i, 8);
+      hash ^= RotateLeft(word * c1, 31) * c2;
+      hash = RotateLeft(hash, 27) * 5 + 0x52dce729;
+    }
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < length; i++, shift += 8) {
+      tail |= static_cast<uint64_t>(bytes[i]) << shift;
+    }
+    hash ^= RotateLeft(tail * c1, 31) * c2;
+    // Finalise so that every input bit affects every output bit
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
   /*
     Initialise and return a VipsImage from a buffer. Supports JPEG, PNG, WebP and TIFF.
   */
@@ -94,6 +151,50 @@ namespace sharp {
     return vips_image_new_from_file(file, "access", access, NULL);
   }
 
+  /*
+    Get a non-negative integral OpenSlide property, or -1 when it is missing
+  */
+  static int OpenSlideProperty(VipsImage *image, std::string const &name) {
+    char const *value;
+    if (vips_image_get_typeof(image, name.c_str()) == 0 || vips_image_get_string(image, name.c_str(), &value)) {
+      vips_error_clear();
+      return -1;
+    }
+    gint64 number = g_ascii_strtoll(value, NULL, 10);
+    return (number >= 0 && number <= INT_MAX) ? static_cast<int>(number) : -1;
+  }
+
+  /*
+    Get the resolution levels of an OpenSlide image from its properties, from full resolution downwards.
+  */
+  std::vector<ImageLevel> OpenSlideLevels(VipsImage *image) {
+    std::vector<ImageLevel> levels;
+    int count = OpenSlideProperty(image, "openslide.level-count");
+    for (int i = 0; i < count; i++) {
+      std::string prefix = "openslide.level[" + std::to_string(i) + "].";
+      ImageLevel level = { i, OpenSlideProperty(image, prefix + "width"), OpenSlideProperty(image, prefix + "height") };
+      if (level.width <= 0 || level.height <= 0) {
+        break;
+      }
+      levels.push_back(level);
+    }
+    return levels;
+  }
+
+  /*
+    Choose the smallest resolution level no more than shrink times smaller than the first, allowing for rounding.
+    Returns the position of the level within levels, which is 0 for the full resolution level or when there are none.
+  */
+  size_t ChooseLevel(std::vector<ImageLevel> const &levels, double const shrink) {
+    size_t chosen = 0;
+    for (size_t i = 1; i < levels.size(); i++) {
+      if ((levels[i].width + 1) * shrink > levels[0].width && (levels[i].height + 1) * shrink > levels[0].height) {
+        chosen = i;
+      }
+    }
+    return chosen;
+  }
+
   /*
     Does this image have an embedded profile?
   */
@@ -101,6 +202,91 @@ namespace sharp {
     return (vips_image_get_typeof(image, VIPS_META_ICC_NAME) > 0) ? TRUE : FALSE;
   }
 
+  /*
+    Read a big-endian 32-bit value from ICC profile data
+  */
+  static guint32 ReadProfileUint32(unsigned char const *data) {
+    return (static_cast<guint32>(data[0]) << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+  }
+
+  /*
+    Get the ASCII description of an ICC profile from its 'desc' tag, of type 'desc' (v2) or 'mluc' (v4).
+    Returns an empty string if there is none.
+  */
+  static std::string ProfileDescription(unsigned char const *data, size_t const length) {
+    std::string description;
+    if (length < 132) {
+      return description;
+    }
+    guint32 tags = ReadProfileUint32(data + 128);
+    for (guint32 i = 0; i < tags && 144 + i * 12 <= length; i++) {
+      unsigned char const *entry = data + 132 + i * 12;
+      if (memcmp(entry, "desc", 4) != 0) {
+        continue;
+      }
+      size_t offset = ReadProfileUint32(entry + 4);
+      size_t size = ReadProfileUint32(entry + 8);
+      if (offset > length || size > length - offset || size < 16) {
+        break;
+      }
+      unsigned char const *tag = data + offset;
+      if (memcmp(tag, "desc", 4) == 0) {
+        size_t count = std::min(static_cast<size_t>(ReadProfileUint32(tag + 8)), size - 12);
+        description.assign(reinterpret_cast<char const*>(tag + 12), count);
+        description = description.substr(0, description.find('\0'));
+      } else if (memcmp(tag, "mluc", 4) == 0 && size >= 28 && ReadProfileUint32(tag + 8) > 0) {
+        // First record, in UTF-16BE
+        size_t count = ReadProfileUint32(tag + 20);
+        size_t start = ReadProfileUint32(tag + 24);
+        if (start <= size && count <= size - start) {
+          for (size_t c = 0; c + 1 < count; c += 2) {
+            description.push_back(tag[start + c] == 0 ? static_cast<char>(tag[start + c + 1]) : '?');
+          }
+        }
+      }
+      break;
+    }
+    return description;
+  }
+
+  bool HasSrgbProfile(VipsImage *image, std::string const &srgbProfile) {
+    void *data;
+    size_t length;
+    if (!HasProfile(image) || vips_image_get_blob(image, VIPS_META_ICC_NAME, &data, &length) || length < 132) {
+      return FALSE;
+    }
+    unsigned char const *profile = static_cast<unsigned char const*>(data);
+    // Data colour space must be RGB
+    if (memcmp(profile + 16, "RGB ", 4) != 0) {
+      return FALSE;
+    }
+    // Identical to the profile transformed to
+    std::string target;
+    if (GetProfile(srgbProfile, target) && target.length() == length && memcmp(target.data(), profile, length) == 0) {
+      return TRUE;
+    }
+    // Known sRGB profiles, as embedded by cameras and image editors, identified by description, size and MD5.
+    // Other profiles share these descriptions but differ, such as in version or black point.
+    static struct {
+      char const *description;
+      size_t length;
+      char const *md5;
+    } const known[] = {
+      { "sRGB IEC61966-2.1", 3144, "1d3fda2edb4a89ab60a23c5f7c7d81dd" },
+      { "sRGB IEC61966-2-1 black scaled", 3048, "060e79448f1454582be37b3de490da2f" }
+    };
+    std::string description = ProfileDescription(profile, length);
+    for (auto const &entry : known) {
+      if (description == entry.description && length == entry.length) {
+        gchar *md5 = g_compute_checksum_for_data(G_CHECKSUM_MD5, profile, length);
+        bool matches = strcmp(md5, entry.md5) == 0;
+        g_free(md5);
+        return matches;
+      }
+    }
+    return FALSE;
+  }
+
   /*
     Does this image have an alpha channel?
     Uses colour space interpretation with number of channels to guess this.
@@ -113,6 +299,80 @@ namespace sharp {
     );
   }
 
+  bool CanNormaliseInPlace(VipsImage *image) {
+    int const colours = image->Bands - (HasAlpha(image) ? 1 : 0);
+    return image->BandFmt == VIPS_FORMAT_UCHAR && (colours == 1 || colours == 3);
+  }
+
+  void NormaliseInPlace(VipsImage *image, double const lower, double const upper) {
+    int const bands = image->Bands;
+    int const colours = bands - (HasAlpha(image) ? 1 : 0);
+    // Histogram of luminance, using integer Rec. 601 weights for RGB
+    guint64 histogram[256] = { 0 };
+    for (int y = 0; y < image->Ysize; y++) {
+      guchar const *p = VIPS_IMAGE_ADDR(image, 0, y);
+      for (int x = 0; x < image->Xsize; x++, p += bands) {
+        int const luminance = (colours == 3) ? (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8 : p[0];
+        histogram[luminance]++;
+      }
+    }
+    // Find the darkest and brightest luminance remaining once the percentiles are clipped
+    guint64 const pixels = VIPS_IMAGE_N_PELS(image);
+    guint64 const belowLow = static_cast<guint64>(pixels * lower / 100.0);
+    guint64 const aboveHigh = static_cast<guint64>(pixels * (100.0 - upper) / 100.0);
+    int low = 0;
+    guint64 count = histogram[low];
+    while (low < 255 && count <= belowLow) {
+      count += histogram[++low];
+    }
+    int high = 255;
+    count = histogram[high];
+    while (high > 0 && count <= aboveHigh) {
+      count += histogram[--high];
+    }
+    // Lookup table to stretch luminance from low to high, or to black when there is no range
+    guchar lut[256];
+    for (int v = 0; v < 256; v++) {
+      if (high > low) {
+        double const stretched = round((v - low) * 255.0 / (high - low));
+        lut[v] = static_cast<guchar>(std::min(std::max(stretched, 0.0), 255.0));
+      } else {
+        lut[v] = 0;
+      }
+    }
+    if (colours == 1) {
+      for (int y = 0; y < image->Ysize; y++) {
+        guchar *p = VIPS_IMAGE_ADDR(image, 0, y);
+        for (int x = 0; x < image->Xsize; x++, p += bands) {
+          p[0] = lut[p[0]];
+        }
+      }
+      return;
+    }
+    // Scale RGB proportionally by the ratio of stretched to original luminance, keeping hue and saturation,
+    // limited so that no channel exceeds 255
+    double scale[256];
+    scale[0] = 0.0;
+    for (int v = 1; v < 256; v++) {
+      scale[v] = lut[v] / static_cast<double>(v);
+    }
+    for (int y = 0; y < image->Ysize; y++) {
+      guchar *p = VIPS_IMAGE_ADDR(image, 0, y);
+      for (int x = 0; x < image->Xsize; x++, p += bands) {
+        int const luminance = (77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8;
+        int const brightest = std::max(std::max(p[0], p[1]), p[2]);
+        if (luminance == 0) {
+          p[0] = p[1] = p[2] = 0;
+          continue;
+        }
+        double const factor = std::min(scale[luminance], 255.0 / brightest);
+        for (int b = 0; b < 3; b++) {
+          p[b] = static_cast<guchar>(std::min(round(p[b] * factor), 255.0));
+        }
+      }
+    }
+  }
+
   /*
     Get EXIF Orientation of image, if any.
   */
@@ -133,7 +393,7 @@ namespace sharp {
     a window size of 3 means a 3x3 pixel grid is used for the calculation.
   */
   int InterpolatorWindowSize(char const *name) {
-    VipsInterpolate *interpolator = vips_interpolate_new(name);
+    VipsInterpolate *interpolator = GetInterpolator(name);
     if (interpolator == NULL) {
       return -1;
     }
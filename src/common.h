@@ -1,6 +1,10 @@
 #ifndef SRC_COMMON_H_
 #define SRC_COMMON_H_
 
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 namespace sharp {
 
   enum class ImageType {
@@ -13,18 +17,31 @@ namespace sharp {
     OPENSLIDE
   };
 
+  /*
+    A resolution level of a multi-resolution image: the page of a TIFF or the level of an OpenSlide image to load
+  */
+  struct ImageLevel {
+    int index;
+    int width;
+    int height;
+  };
+
   // How many tasks are in the queue?
   extern volatile int counterQueue;
 
   // How many tasks are being processed?
   extern volatile int counterProcess;
 
+  // How many tasks have been rejected by a full queue?
+  extern volatile int counterRejected;
+
   // Filename extension checkers
   bool IsJpeg(std::string const &str);
   bool IsPng(std::string const &str);
   bool IsWebp(std::string const &str);
   bool IsTiff(std::string const &str);
   bool IsDz(std::string const &str);
+  bool IsDzZip(std::string const &str);
 
   /*
     Determine image format of a buffer.
@@ -36,6 +53,16 @@ namespace sharp {
   */
   ImageType DetermineImageType(char const *file);
 
+  /*
+    Join chunks of data, for example from a Stream, into a single newly-allocated char[] buffer.
+  */
+  char* JoinChunks(std::vector<std::pair<char*, size_t>> const &chunks, size_t const length);
+
+  /*
+    Fast, non-cryptographic 64-bit hash of data, for identifying repeated inputs within this process.
+  */
+  uint64_t HashData(void const *data, size_t const length);
+
   /*
     Initialise and return a VipsImage from a buffer. Supports JPEG, PNG, WebP and TIFF.
   */
@@ -46,17 +73,46 @@ namespace sharp {
   */
   VipsImage* InitImage(char const *file, VipsAccess const access);
 
+  /*
+    Get the resolution levels of an OpenSlide image from its properties, from full resolution downwards.
+  */
+  std::vector<ImageLevel> OpenSlideLevels(VipsImage *image);
+
+  /*
+    Choose the smallest resolution level no more than shrink times smaller than the first, allowing for rounding.
+    Returns the position of the level within levels, which is 0 for the full resolution level or when there are none.
+  */
+  size_t ChooseLevel(std::vector<ImageLevel> const &levels, double const shrink);
+
   /*
     Does this image have an embedded profile?
   */
   bool HasProfile(VipsImage *image);
 
+  /*
+    Is the embedded profile sRGB, making a transform to sRGB an identity?
+    Matches the content of the sRGB profile file given, or the description, size and MD5 of a known sRGB profile.
+  */
+  bool HasSrgbProfile(VipsImage *image, std::string const &srgbProfile);
+
   /*
     Does this image have an alpha channel?
     Uses colour space interpretation with number of channels to guess this.
   */
   bool HasAlpha(VipsImage *image);
 
+  /*
+    Can an image be normalised in place with an 8-bit lookup table? Requires greyscale or RGB, with optional alpha.
+  */
+  bool CanNormaliseInPlace(VipsImage *image);
+
+  /*
+    Stretch the luminance of an 8-bit image held in memory to cover the full range, modifying it in place.
+    The lower and upper percentiles of luminance are clipped, RGB is scaled proportionally to keep its hue and
+    saturation, and alpha is unchanged.
+  */
+  void NormaliseInPlace(VipsImage *image, double const lower, double const upper);
+
   /*
     Get EXIF Orientation of image, if any.
   */
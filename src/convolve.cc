@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <vips/vips.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SHARP_CONVOLVE_X86
+#include <immintrin.h>
+#endif
+
+#include "convolve.h"
+
+namespace sharp {
+
+  /*
+    Row functions, each processing n interleaved 8-bit samples
+  */
+  typedef void (*AccumulateFn)(int *sums, guchar const *p, int const coefficient, int const n);
+  typedef void (*ToFloatFn)(float *q, int const *sums, double const scale, int const n);
+  typedef void (*ToUcharFn)(guchar *q, int const *sums, int const rounding, double const scale, int const n);
+
+  struct Kernels {
+    char const *name;
+    AccumulateFn accumulate;
+    ToFloatFn toFloat;
+    ToUcharFn toUchar;
+  };
+
+  struct Tap {
+    int x;
+    int y;
+    int coefficient;
+  };
+
+  struct Convolution {
+    // Input with edges extended, referenced until the output is closed
+    VipsImage *in;
+    int width;
+    int height;
+    // Non-zero coefficients of the matrix
+    std::vector<Tap> taps;
+    int scale;
+    // Rounded, clipped 8-bit output as per integer precision, otherwise float
+    bool rounded;
+    Kernels const *kernels;
+  };
+
+  static void AccumulateScalar(int *sums, guchar const *p, int const coefficient, int const n) {
+    for (int i = 0; i < n; i++) {
+      sums[i] += coefficient * p[i];
+    }
+  }
+
+  /*
+    As per vips_conv with float precision: divide by the scale in double precision, then store as float
+  */
+  static void ToFloatScalar(float *q, int const *sums, double const scale, int const n) {
+    for (int i = 0; i < n; i++) {
+      q[i] = static_cast<float>(static_cast<double>(sums[i]) / scale);
+    }
+  }
+
+  /*
+    As per vips_conv with integer precision: add half the scale, divide by it rounding towards zero, then clip
+  */
+  static void ToUcharScalar(guchar *q, int const *sums, int const rounding, double const scale, int const n) {
+    int const divisor = static_cast<int>(scale);
+    for (int i = 0; i < n; i++) {
+      int const value = (sums[i] + rounding) / divisor;
+      q[i] = static_cast<guchar>(std::min(std::max(value, 0), 255));
+    }
+  }
+
+  static Kernels const scalar = { "scalar", AccumulateScalar, ToFloatScalar, ToUcharScalar };
+
+#ifdef SHARP_CONVOLVE_X86
+  /*
+    The SIMD versions divide integer sums in double precision, truncating towards zero.
+    For sums and divisors below 2^31 this always matches integer division, as a quotient that is not integral
+    lies at least 1/divisor below the next integer, far more than the rounding error of a double.
+  */
+
+  __attribute__((target("sse4.1")))
+  static void AccumulateSse41(int *sums, guchar const *p, int const coefficient, int const n) {
+    __m128i const c = _mm_set1_epi32(coefficient);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      int packed;
+      memcpy(&packed, p + i, 4);
+      __m128i const v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+      __m128i const s = _mm_loadu_si128(reinterpret_cast<__m128i const*>(sums + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), _mm_add_epi32(s, _mm_mullo_epi32(v, c)));
+    }
+    AccumulateScalar(sums + i, p + i, coefficient, n - i);
+  }
+
+  __attribute__((target("sse4.1")))
+  static void ToFloatSse41(float *q, int const *sums, double const scale, int const n) {
+    __m128d const s = _mm_set1_pd(scale);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(sums + i));
+      __m128 const lo = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(v), s));
+      __m128 const hi = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2))), s));
+      _mm_storeu_ps(q + i, _mm_movelh_ps(lo, hi));
+    }
+    ToFloatScalar(q + i, sums + i, scale, n - i);
+  }
+
+  __attribute__((target("sse4.1")))
+  static void ToUcharSse41(guchar *q, int const *sums, int const rounding, double const scale, int const n) {
+    __m128d const s = _mm_set1_pd(scale);
+    __m128i const r = _mm_set1_epi32(rounding);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+      __m128i const v = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(sums + i)), r);
+      __m128i const lo = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(v), s));
+      __m128i const hi = _mm_cvttpd_epi32(_mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2))), s));
+      __m128i const words = _mm_packs_epi32(_mm_unpacklo_epi64(lo, hi), _mm_setzero_si128());
+      int const packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+      memcpy(q + i, &packed, 4);
+    }
+    ToUcharScalar(q + i, sums + i, rounding, scale, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static void AccumulateAvx2(int *sums, guchar const *p, int const coefficient, int const n) {
+    __m256i const c = _mm256_set1_epi32(coefficient);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i const v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(p + i)));
+      __m256i const s = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(sums + i));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(sums + i), _mm256_add_epi32(s, _mm256_mullo_epi32(v, c)));
+    }
+    AccumulateScalar(sums + i, p + i, coefficient, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static void ToFloatAvx2(float *q, int const *sums, double const scale, int const n) {
+    __m256d const s = _mm256_set1_pd(scale);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i const v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(sums + i));
+      _mm_storeu_ps(q + i, _mm256_cvtpd_ps(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s)));
+      _mm_storeu_ps(q + i + 4, _mm256_cvtpd_ps(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s)));
+    }
+    ToFloatScalar(q + i, sums + i, scale, n - i);
+  }
+
+  __attribute__((target("avx2")))
+  static void ToUcharAvx2(guchar *q, int const *sums, int const rounding, double const scale, int const n) {
+    __m256d const s = _mm256_set1_pd(scale);
+    __m256i const r = _mm256_set1_epi32(rounding);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+      __m256i const v = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(sums + i)), r);
+      __m128i const lo = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s));
+      __m128i const hi = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s));
+      __m128i const words = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(q + i), _mm_packus_epi16(words, words));
+    }
+    ToUcharScalar(q + i, sums + i, rounding, scale, n - i);
+  }
+
+  static Kernels const sse41 = { "sse4.1", AccumulateSse41, ToFloatSse41, ToUcharSse41 };
+  static Kernels const avx2 = { "avx2", AccumulateAvx2, ToFloatAvx2, ToUcharAvx2 };
+#endif
+
+  /*
+    Select the widest instruction set supported by this CPU
+  */
+  static Kernels const* Detect() {
+#ifdef SHARP_CONVOLVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return &avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+      return &sse41;
+    }
+#endif
+    return &scalar;
+  }
+
+  static Kernels const* Detected() {
+    static Kernels const *detected = Detect();
+    return detected;
+  }
+
+  static volatile int enabled = TRUE;
+
+  /*
+    Used as the callback function for the "postclose" signal of the output image
+  */
+  static void FreeConvolution(VipsObject *object, Convolution *convolution) {
+    if (convolution->in != NULL) {
+      g_object_unref(convolution->in);
+    }
+    delete convolution;
+  }
+
+  /*
+    Prepare a convolution of an image with a matrix, or return NULL if it is not supported, leaving libvips to do it.
+  */
+  static Convolution* NewConvolution(VipsImage *image, VipsImage *matrix, bool const rounded) {
+#if (VIPS_MAJOR_VERSION >= 8)
+    double scale;
+    double offset;
+    if (
+      !g_atomic_int_get(&enabled) ||
+      image->BandFmt != VIPS_FORMAT_UCHAR || image->Bands < 1 || image->Bands > 4 ||
+      matrix->Xsize % 2 == 0 || matrix->Ysize % 2 == 0 ||
+      vips_image_get_double(matrix, "scale", &scale) || vips_image_get_double(matrix, "offset", &offset) ||
+      offset != 0.0 || scale < 1.0 || scale != floor(scale) || scale > 65536.0
+    ) {
+      return NULL;
+    }
+    Convolution *convolution = new Convolution;
+    convolution->in = NULL;
+    convolution->width = matrix->Xsize;
+    convolution->height = matrix->Ysize;
+    convolution->scale = static_cast<int>(scale);
+    convolution->rounded = rounded;
+    convolution->kernels = Detected();
+    // Coefficients must be integral, with sums that cannot overflow
+    double magnitude = 0.0;
+    for (int y = 0; y < matrix->Ysize; y++) {
+      for (int x = 0; x < matrix->Xsize; x++) {
+        double const coefficient = *VIPS_MATRIX(matrix, x, y);
+        magnitude += std::abs(coefficient) * 255.0;
+        if (coefficient != floor(coefficient) || magnitude > 1073741824.0) {
+          delete convolution;
+          return NULL;
+        }
+        if (coefficient != 0.0) {
+          Tap tap = { x, y, static_cast<int>(coefficient) };
+          convolution->taps.push_back(tap);
+        }
+      }
+    }
+    return convolution;
+#else
+    return NULL;
+#endif
+  }
+
+  /*
+    Generate a region of output from the corresponding region of edge-extended input
+  */
+  static int Generate(VipsRegion *out, void *seq, void *a, void *b, gboolean *stop) {
+    VipsRegion *ir = static_cast<VipsRegion*>(seq);
+    Convolution const *convolution = static_cast<Convolution const*>(b);
+    Kernels const *kernels = convolution->kernels;
+    VipsRect const *r = &out->valid;
+    VipsRect need = { r->left, r->top, r->width + convolution->width - 1, r->height + convolution->height - 1 };
+    if (vips_region_prepare(ir, &need)) {
+      return -1;
+    }
+    int const n = r->width * out->im->Bands;
+    double const scale = static_cast<double>(convolution->scale);
+    int const rounding = (convolution->scale + 1) / 2;
+    std::vector<int> sums(n);
+    for (int y = 0; y < r->height; y++) {
+      std::fill(sums.begin(), sums.end(), 0);
+      for (Tap const &tap : convolution->taps) {
+        kernels->accumulate(sums.data(), VIPS_REGION_ADDR(ir, r->left + tap.x, r->top + y + tap.y), tap.coefficient, n);
+      }
+      if (convolution->rounded) {
+        kernels->toUchar(VIPS_REGION_ADDR(out, r->left, r->top + y), sums.data(), rounding, scale, n);
+      } else {
+        kernels->toFloat(reinterpret_cast<float*>(VIPS_REGION_ADDR(out, r->left, r->top + y)), sums.data(), scale, n);
+      }
+    }
+    return 0;
+  }
+
+  /*
+    Apply a prepared convolution, taking ownership of it.
+    As with vips_conv, edges are extended by copying so the output is the same size as the input.
+  */
+  static int Apply(VipsImage *in, VipsImage **out, Convolution *convolution) {
+    VipsImage *extended;
+    if (vips_embed(in, &extended, convolution->width / 2, convolution->height / 2,
+      in->Xsize + convolution->width - 1, in->Ysize + convolution->height - 1, "extend", VIPS_EXTEND_COPY, NULL
+    )) {
+      delete convolution;
+      return -1;
+    }
+    convolution->in = extended;
+    *out = vips_image_new();
+    g_signal_connect(*out, "postclose", G_CALLBACK(FreeConvolution), convolution);
+    if (vips_image_pipelinev(*out, VIPS_DEMAND_STYLE_SMALLTILE, extended, NULL)) {
+      g_object_unref(*out);
+      return -1;
+    }
+    (*out)->Xsize = in->Xsize;
+    (*out)->Ysize = in->Ysize;
+    if (!convolution->rounded) {
+      (*out)->BandFmt = VIPS_FORMAT_FLOAT;
+    }
+    if (vips_image_generate(*out, vips_start_one, Generate, vips_stop_one, extended, convolution)) {
+      g_object_unref(*out);
+      return -1;
+    }
+    return 0;
+  }
+
+  int Convolve(VipsImage *in, VipsImage **out, VipsImage *matrix) {
+    Convolution *convolution = NewConvolution(in, matrix, FALSE);
+    if (convolution == NULL) {
+      return vips_conv(in, out, matrix, NULL);
+    }
+    return Apply(in, out, convolution);
+  }
+
+  int ConvolveSeparable(VipsImage *in, VipsImage **out, VipsImage *matrix) {
+    Convolution *first = (matrix->Xsize == 1 || matrix->Ysize == 1) ? NewConvolution(in, matrix, TRUE) : NULL;
+    if (first == NULL) {
+      return vips_convsep(in, out, matrix, "precision", VIPS_PRECISION_INTEGER, NULL);
+    }
+    // As per vips_convsep, apply the matrix then its rotation, rounding between passes
+    Convolution *second = new Convolution(*first);
+    std::swap(second->width, second->height);
+    for (Tap &tap : second->taps) {
+      std::swap(tap.x, tap.y);
+    }
+    VipsImage *pass;
+    if (Apply(in, &pass, first)) {
+      delete second;
+      return -1;
+    }
+    int status = Apply(pass, out, second);
+    g_object_unref(pass);
+    return status;
+  }
+
+  std::string ConvolveInstructions() {
+#if (VIPS_MAJOR_VERSION >= 8)
+    return g_atomic_int_get(&enabled) ? Detected()->name : "none";
+#else
+    return "none";
+#endif
+  }
+
+  void SetConvolveEnabled(bool const enable) {
+    g_atomic_int_set(&enabled, enable ? TRUE : FALSE);
+  }
+
+}  // namespace sharp
@@ -0,0 +1,34 @@
+#ifndef SRC_CONVOLVE_H_
+#define SRC_CONVOLVE_H_
+
+#include <string>
+
+#include <vips/vips.h>
+
+namespace sharp {
+
+  /*
+    Convolve with a matrix of integer coefficients, with results identical to vips_conv and its default float precision.
+    8-bit images of 1 to 4 bands use SIMD instructions where available, others use vips_conv.
+  */
+  int Convolve(VipsImage *in, VipsImage **out, VipsImage *matrix);
+
+  /*
+    Convolve with a separable matrix of integer coefficients, with results identical to vips_convsep and integer precision.
+    8-bit images of 1 to 4 bands use SIMD instructions where available, others use vips_convsep.
+  */
+  int ConvolveSeparable(VipsImage *in, VipsImage **out, VipsImage *matrix);
+
+  /*
+    Get the instruction set used for convolution: "avx2", "sse4.1", "scalar", or "none" when disabled in favour of libvips.
+  */
+  std::string ConvolveInstructions();
+
+  /*
+    Enable or disable this module's convolution, falling back to libvips when disabled
+  */
+  void SetConvolveEnabled(bool const enable);
+
+}  // namespace sharp
+
+#endif  // SRC_CONVOLVE_H_
@@ -0,0 +1,466 @@
+#include <cmath>
+#include <cstdio>
+#include <climits>
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+#include <glib/gstdio.h>
+#include <vips/vips.h>
+
+#include "common.h"
+#include "header.h"
+
+namespace sharp {
+
+  /*
+    Random access to the bytes of image data held in memory or in a file
+  */
+  class HeaderReader {
+
+   public:
+    HeaderReader(void const *buffer, size_t const length):
+      buffer(static_cast<unsigned char const*>(buffer)), length(length), file(NULL) {}
+    explicit HeaderReader(FILE *file):
+      buffer(NULL), length(0), file(file) {}
+
+    /*
+      Pointer to count bytes at offset, or NULL when these lie beyond the end of the data.
+      Bytes read from a file remain valid only until the next call.
+    */
+    unsigned char const* Read(size_t const offset, size_t const count) {
+      if (file == NULL) {
+        if (offset > length || count > length - offset) {
+          return NULL;
+        }
+        return buffer + offset;
+      }
+      if (offset > LONG_MAX || fseek(file, static_cast<long>(offset), SEEK_SET) != 0) {  // NOLINT(runtime/int)
+        return NULL;
+      }
+      scratch.resize(count);
+      if (fread(scratch.data(), 1, count, file) != count) {
+        return NULL;
+      }
+      return scratch.data();
+    }
+
+   private:
+    unsigned char const *buffer;
+    size_t length;
+    FILE *file;
+    std::vector<unsigned char> scratch;
+  };
+
+  static unsigned int ReadUint16(unsigned char const *data, bool const bigEndian) {
+    return bigEndian
+      ? (static_cast<unsigned int>(data[0]) << 8) | data[1]
+      : (static_cast<unsigned int>(data[1]) << 8) | data[0];
+  }
+
+  static unsigned int ReadUint32(unsigned char const *data, bool const bigEndian) {
+    return bigEndian
+      ? (ReadUint16(data, TRUE) << 16) | ReadUint16(data + 2, TRUE)
+      : (ReadUint16(data + 2, FALSE) << 16) | ReadUint16(data, FALSE);
+  }
+
+  /*
+    Read the byte order and the offset of the first image file directory of TIFF structured data starting at base
+  */
+  static bool ParseTiffByteOrder(HeaderReader &reader, size_t const base, bool &bigEndian, size_t &offset) {
+    unsigned char const *data = reader.Read(base, 8);
+    if (data == NULL) {
+      return FALSE;
+    }
+    if (memcmp(data, "II*\0", 4) == 0) {
+      bigEndian = FALSE;
+    } else if (memcmp(data, "MM\0*", 4) == 0) {
+      bigEndian = TRUE;
+    } else {
+      return FALSE;
+    }
+    offset = base + ReadUint32(data + 4, bigEndian);
+    return TRUE;
+  }
+
+  /*
+    Read the entries of the image file directory (IFD) at offset within TIFF structured data starting at base,
+    and the offset of the next IFD, which is 0 after the last one.
+    Each tag maps to its first value when numeric, otherwise to its count of values.
+  */
+  static bool ParseIfd(HeaderReader &reader, size_t const base, bool const bigEndian, size_t const offset,
+    std::map<unsigned int, unsigned int> &entries, size_t &next) {
+    unsigned char const *data = reader.Read(offset, 2);
+    if (data == NULL) {
+      return FALSE;
+    }
+    unsigned int count = ReadUint16(data, bigEndian);
+    for (unsigned int i = 0; i < count; i++) {
+      unsigned char const *entry = reader.Read(offset + 2 + i * 12, 12);
+      if (entry == NULL) {
+        return FALSE;
+      }
+      unsigned int tag = ReadUint16(entry, bigEndian);
+      unsigned int type = ReadUint16(entry + 2, bigEndian);
+      unsigned int values = ReadUint32(entry + 4, bigEndian);
+      if (type == 3) {
+        // SHORT, held in place when they fit in 4 bytes
+        if (values <= 2) {
+          entries[tag] = ReadUint16(entry + 8, bigEndian);
+        } else {
+          unsigned char const *value = reader.Read(base + ReadUint32(entry + 8, bigEndian), 2);
+          if (value == NULL) {
+            return FALSE;
+          }
+          entries[tag] = ReadUint16(value, bigEndian);
+        }
+      } else if (type == 4) {
+        // LONG, held in place when there is only one
+        if (values == 1) {
+          entries[tag] = ReadUint32(entry + 8, bigEndian);
+        } else {
+          unsigned char const *value = reader.Read(base + ReadUint32(entry + 8, bigEndian), 4);
+          if (value == NULL) {
+            return FALSE;
+          }
+          entries[tag] = ReadUint32(value, bigEndian);
+        }
+      } else {
+        entries[tag] = values;
+      }
+    }
+    data = reader.Read(offset + 2 + count * 12, 4);
+    unsigned int nextOffset = (data == NULL) ? 0 : ReadUint32(data, bigEndian);
+    next = (nextOffset == 0) ? 0 : base + nextOffset;
+    return TRUE;
+  }
+
+  /*
+    Read the entries of the first image file directory (IFD0) of TIFF structured data starting at base,
+    as used by both TIFF images and EXIF metadata.
+  */
+  static bool ParseIfd0(HeaderReader &reader, size_t const base, std::map<unsigned int, unsigned int> &entries) {
+    bool bigEndian;
+    size_t offset;
+    size_t next;
+    return ParseTiffByteOrder(reader, base, bigEndian, offset) && ParseIfd(reader, base, bigEndian, offset, entries, next);
+  }
+
+  /*
+    JPEG: scan marker segments for the EXIF Orientation, an ICC profile and the start of frame
+  */
+  static bool ParseJpeg(HeaderReader &reader, ImageHeader &header) {
+    size_t offset = 2;
+    while (TRUE) {
+      unsigned char const *marker = reader.Read(offset, 4);
+      if (marker == NULL || marker[0] != 0xFF) {
+        return FALSE;
+      }
+      unsigned char code = marker[1];
+      if (code == 0xFF) {
+        // Fill byte
+        offset++;
+        continue;
+      }
+      if (code == 0x01 || (code >= 0xD0 && code <= 0xD8)) {
+        // Marker without a segment
+        offset += 2;
+        continue;
+      }
+      if (code == 0xD9 || code == 0xDA) {
+        // End of image or start of scan, without a frame header
+        return FALSE;
+      }
+      size_t segmentLength = ReadUint16(marker + 2, TRUE);
+      if (segmentLength < 2) {
+        return FALSE;
+      }
+      if (code >= 0xC0 && code <= 0xCF && code != 0xC4 && code != 0xC8 && code != 0xCC) {
+        // Start of frame
+        unsigned char const *frame = reader.Read(offset + 4, 6);
+        if (frame == NULL || frame[0] != 8) {
+          // libjpeg decodes 8-bit precision only
+          return FALSE;
+        }
+        header.height = ReadUint16(frame + 1, TRUE);
+        header.width = ReadUint16(frame + 3, TRUE);
+        header.channels = frame[5];
+        switch (header.channels) {
+          case 1: header.space = "b-w"; break;
+          case 3: header.space = "srgb"; break;
+          case 4: header.space = "cmyk"; break;
+          default: return FALSE;
+        }
+        header.hasAlpha = FALSE;
+        return header.width > 0 && header.height > 0;
+      } else if (code == 0xE1 && segmentLength > 16 && header.orientation == 0) {
+        // APP1, which may hold EXIF metadata
+        unsigned char const *app = reader.Read(offset + 4, 6);
+        if (app != NULL && memcmp(app, "Exif\0\0", 6) == 0) {
+          std::map<unsigned int, unsigned int> exif;
+          if (ParseIfd0(reader, offset + 10, exif) && exif.count(274) == 1 && exif[274] >= 1 && exif[274] <= 8) {
+            header.orientation = exif[274];
+          }
+        }
+      } else if (code == 0xE2 && segmentLength > 16) {
+        // APP2, which may hold an ICC profile
+        unsigned char const *app = reader.Read(offset + 4, 12);
+        if (app != NULL && memcmp(app, "ICC_PROFILE\0", 12) == 0) {
+          header.hasProfile = TRUE;
+        }
+      }
+      offset += 2 + segmentLength;
+    }
+  }
+
+  /*
+    PNG: read IHDR, then scan chunks up to the image data for transparency and an ICC profile
+  */
+  static bool ParsePng(HeaderReader &reader, ImageHeader &header) {
+    unsigned char const *ihdr = reader.Read(8, 21);
+    if (ihdr == NULL || memcmp(ihdr + 4, "IHDR", 4) != 0) {
+      return FALSE;
+    }
+    header.width = ReadUint32(ihdr + 8, TRUE);
+    header.height = ReadUint32(ihdr + 12, TRUE);
+    int depth = ihdr[16];
+    int colourType = ihdr[17];
+    switch (colourType) {
+      case 0: header.channels = 1; break;  // Greyscale
+      case 2: header.channels = 3; break;  // RGB
+      case 3: header.channels = 3; break;  // Palette, expanded to RGB
+      case 4: header.channels = 2; break;  // Greyscale with alpha
+      case 6: header.channels = 4; break;  // RGB with alpha
+      default: return FALSE;
+    }
+    size_t offset = 8;
+    while (TRUE) {
+      unsigned char const *chunk = reader.Read(offset, 8);
+      if (chunk == NULL) {
+        return FALSE;
+      }
+      if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+        break;
+      } else if (memcmp(chunk + 4, "iCCP", 4) == 0) {
+        header.hasProfile = TRUE;
+      } else if (memcmp(chunk + 4, "tRNS", 4) == 0 && (colourType == 0 || colourType == 2 || colourType == 3)) {
+        // Transparency is expanded to an alpha channel
+        header.channels++;
+      }
+      offset += 12 + ReadUint32(chunk, TRUE);
+    }
+    if (header.channels <= 2) {
+      header.space = (depth == 16) ? "grey16" : "b-w";
+    } else {
+      header.space = (depth == 16) ? "rgb16" : "srgb";
+    }
+    header.hasAlpha = header.channels == 2 || header.channels == 4;
+    return header.width > 0 && header.height > 0;
+  }
+
+  /*
+    WebP: read the dimensions and alpha flag from the first chunk, which is one of VP8, VP8L or VP8X
+  */
+  static bool ParseWebp(HeaderReader &reader, ImageHeader &header) {
+    unsigned char const *data = reader.Read(0, 30);
+    if (data == NULL) {
+      return FALSE;
+    }
+    bool alpha = FALSE;
+    if (memcmp(data + 12, "VP8 ", 4) == 0) {
+      // Lossy, with 14-bit dimensions following the key frame start code
+      if (data[23] != 0x9D || data[24] != 0x01 || data[25] != 0x2A) {
+        return FALSE;
+      }
+      header.width = ReadUint16(data + 26, FALSE) & 0x3FFF;
+      header.height = ReadUint16(data + 28, FALSE) & 0x3FFF;
+    } else if (memcmp(data + 12, "VP8L", 4) == 0) {
+      // Lossless, with 14-bit dimensions and alpha hint packed after the signature
+      if (data[20] != 0x2F) {
+        return FALSE;
+      }
+      unsigned int bits = ReadUint32(data + 21, FALSE);
+      header.width = (bits & 0x3FFF) + 1;
+      header.height = ((bits >> 14) & 0x3FFF) + 1;
+      alpha = (bits >> 28) & 1;
+    } else if (memcmp(data + 12, "VP8X", 4) == 0) {
+      // Extended, with 24-bit canvas dimensions
+      unsigned char flags = data[20];
+      if (flags & (0x20 | 0x08 | 0x02)) {
+        // Whether libvips reads ICC profile and EXIF chunks depends on its version, and animation is unsupported
+        return FALSE;
+      }
+      header.width = 1 + (data[24] | (data[25] << 8) | (data[26] << 16));
+      header.height = 1 + (data[27] | (data[28] << 8) | (data[29] << 16));
+      alpha = (flags & 0x10) != 0;
+    } else {
+      return FALSE;
+    }
+    header.channels = alpha ? 4 : 3;
+    header.space = "srgb";
+    header.hasAlpha = alpha;
+    return header.width > 0 && header.height > 0;
+  }
+
+  /*
+    TIFF: read the dimensions and sample layout of the first image from IFD0.
+    Only bilevel, 8 and 16-bit unsigned greyscale and RGB are handled here.
+  */
+  static bool ParseTiff(HeaderReader &reader, ImageHeader &header) {
+    std::map<unsigned int, unsigned int> ifd;
+    if (!ParseIfd0(reader, 0, ifd) || ifd.count(256) == 0 || ifd.count(257) == 0 || ifd.count(262) == 0) {
+      return FALSE;
+    }
+    header.width = ifd[256];
+    header.height = ifd[257];
+    header.channels = (ifd.count(277) == 1) ? ifd[277] : 1;
+    unsigned int bits = (ifd.count(258) == 1) ? ifd[258] : 1;
+    unsigned int sampleFormat = (ifd.count(339) == 1) ? ifd[339] : 1;
+    if ((bits != 1 && bits != 8 && bits != 16) || sampleFormat != 1) {
+      return FALSE;
+    }
+    unsigned int photometric = ifd[262];
+    if (bits == 1) {
+      // Bilevel, unpacked to 8-bit greyscale
+      if ((photometric != 0 && photometric != 1) || header.channels != 1) {
+        return FALSE;
+      }
+      header.space = "b-w";
+    } else if ((photometric == 0 || photometric == 1) && (header.channels == 1 || header.channels == 2)) {
+      header.space = (bits == 16) ? "grey16" : "b-w";
+    } else if (photometric == 2 && (header.channels == 3 || header.channels == 4)) {
+      header.space = (bits == 16) ? "rgb16" : "srgb";
+    } else {
+      return FALSE;
+    }
+    header.hasProfile = ifd.count(34675) == 1;
+    header.hasAlpha = header.channels == 2 || header.channels == 4;
+    return header.width > 0 && header.height > 0;
+  }
+
+  ImageType SignatureType(void const *buffer, size_t const length) {
+    unsigned char const *signature = static_cast<unsigned char const*>(buffer);
+    if (length >= 3 && memcmp(signature, "\xFF\xD8\xFF", 3) == 0) {
+      return ImageType::JPEG;
+    } else if (length >= 8 && memcmp(signature, "\x89PNG\r\n\x1A\n", 8) == 0) {
+      return ImageType::PNG;
+    } else if (length >= 12 && memcmp(signature, "RIFF", 4) == 0 && memcmp(signature + 8, "WEBP", 4) == 0) {
+      return ImageType::WEBP;
+    } else if (length >= 4 && (memcmp(signature, "II*\0", 4) == 0 || memcmp(signature, "MM\0*", 4) == 0)) {
+      return ImageType::TIFF;
+    }
+    return ImageType::UNKNOWN;
+  }
+
+  /*
+    Identify the image type from its signature and parse the header, if libvips could load it.
+    The suffix distinguishes buffer from file loaders.
+  */
+  static bool ParseHeader(HeaderReader &reader, std::string const &loaderSuffix, ImageHeader &header) {
+    unsigned char const *signature = reader.Read(0, 12);
+    if (signature == NULL) {
+      return FALSE;
+    }
+    header.type = SignatureType(signature, 12);
+    std::string loader;
+    switch (header.type) {
+      case ImageType::JPEG: loader = "jpegload"; break;
+      case ImageType::PNG: loader = "pngload"; break;
+      case ImageType::WEBP: loader = "webpload"; break;
+      case ImageType::TIFF: loader = "tiffload"; break;
+      default: return FALSE;
+    }
+    if (!vips_type_find("VipsOperation", (loader + loaderSuffix).c_str())) {
+      return FALSE;
+    }
+    switch (header.type) {
+      case ImageType::JPEG: return ParseJpeg(reader, header);
+      case ImageType::PNG: return ParsePng(reader, header);
+      case ImageType::WEBP: return ParseWebp(reader, header);
+      case ImageType::TIFF: return ParseTiff(reader, header);
+      default: return FALSE;
+    }
+  }
+
+  /*
+    TIFF: the first page followed by each later page that is a smaller copy of it, keeping its aspect ratio to within
+    rounding, as written for a pyramid. Pages are looked at until the first that cannot be read, up to a limit.
+  */
+  static std::vector<ImageLevel> ParseTiffLevels(HeaderReader &reader) {
+    std::vector<ImageLevel> levels;
+    bool bigEndian;
+    size_t offset;
+    if (!ParseTiffByteOrder(reader, 0, bigEndian, offset)) {
+      return levels;
+    }
+    for (int page = 0; page < 1024 && offset != 0; page++) {
+      std::map<unsigned int, unsigned int> ifd;
+      size_t next;
+      if (!ParseIfd(reader, 0, bigEndian, offset, ifd, next) || next == offset) {
+        break;
+      }
+      if (ifd.count(256) == 1 && ifd.count(257) == 1 && ifd[256] > 0 && ifd[257] > 0) {
+        ImageLevel level = { page, static_cast<int>(ifd[256]), static_cast<int>(ifd[257]) };
+        if (levels.empty()) {
+          levels.push_back(level);
+        } else if (level.width < levels.back().width && level.height < levels.back().height) {
+          double expectedHeight = static_cast<double>(levels.front().height) * level.width / levels.front().width;
+          if (std::abs(expectedHeight - level.height) <= 2.0) {
+            levels.push_back(level);
+          }
+        }
+      }
+      offset = next;
+    }
+    return levels;
+  }
+
+  /*
+    Parse the header of JPEG, PNG, WebP or TIFF image data in a buffer.
+  */
+  bool ParseHeader(void const *buffer, size_t const length, ImageHeader &header) {
+    HeaderReader reader(buffer, length);
+    return ParseHeader(reader, "_buffer", header);
+  }
+
+  /*
+    Parse the header of a JPEG, PNG, WebP or TIFF image file, reading no more of it than required.
+  */
+  bool ParseHeader(char const *file, ImageHeader &header) {
+    FILE *f = g_fopen(file, "rb");
+    if (f == NULL) {
+      return FALSE;
+    }
+    HeaderReader reader(f);
+    bool parsed = ParseHeader(reader, "", header);
+    fclose(f);
+    if (parsed && header.type == ImageType::TIFF && DetermineImageType(file) != ImageType::TIFF) {
+      // TIFF-based formats such as Aperio SVS are loaded via openslide
+      parsed = FALSE;
+    }
+    return parsed;
+  }
+
+  /*
+    Find the resolution levels of TIFF image data in a buffer.
+  */
+  std::vector<ImageLevel> ParseTiffLevels(void const *buffer, size_t const length) {
+    HeaderReader reader(buffer, length);
+    return ParseTiffLevels(reader);
+  }
+
+  /*
+    Find the resolution levels of a TIFF image file, reading only its image file directories.
+  */
+  std::vector<ImageLevel> ParseTiffLevels(char const *file) {
+    std::vector<ImageLevel> levels;
+    FILE *f = g_fopen(file, "rb");
+    if (f != NULL) {
+      HeaderReader reader(f);
+      levels = ParseTiffLevels(reader);
+      fclose(f);
+    }
+    return levels;
+  }
+
+}  // namespace sharp
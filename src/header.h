@@ -0,0 +1,63 @@
+#ifndef SRC_HEADER_H_
+#define SRC_HEADER_H_
+
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+namespace sharp {
+
+  /*
+    Attributes of an image that can be read from its header without decoding it.
+    Values match those libvips reports for the same image.
+  */
+  struct ImageHeader {
+    ImageType type;
+    int width;
+    int height;
+    int channels;
+    std::string space;
+    bool hasProfile;
+    bool hasAlpha;
+    int orientation;
+
+    ImageHeader():
+      type(ImageType::UNKNOWN),
+      width(0),
+      height(0),
+      channels(0),
+      space(""),
+      hasProfile(false),
+      hasAlpha(false),
+      orientation(0) {}
+  };
+
+  /*
+    Identify JPEG, PNG, WebP or TIFF image data from its signature alone, without calling libvips,
+    so safe to use on the JavaScript thread. Other data is UNKNOWN, even if libvips could load it.
+  */
+  ImageType SignatureType(void const *buffer, size_t const length);
+
+  /*
+    Parse the header of JPEG, PNG, WebP or TIFF image data in a buffer.
+    Returns false when the format is not supported, the header is incomplete, or it
+    describes an image that only libvips can interpret, in which case use libvips instead.
+  */
+  bool ParseHeader(void const *buffer, size_t const length, ImageHeader &header);
+
+  /*
+    Parse the header of a JPEG, PNG, WebP or TIFF image file, reading no more of it than required.
+  */
+  bool ParseHeader(char const *file, ImageHeader &header);
+
+  /*
+    Find the resolution levels of a multi-resolution TIFF, being its first page followed by any smaller copies of it,
+    from data in a buffer or a file. A single-resolution TIFF has one level; other data has none.
+  */
+  std::vector<ImageLevel> ParseTiffLevels(void const *buffer, size_t const length);
+  std::vector<ImageLevel> ParseTiffLevels(char const *file);
+
+}  // namespace sharp
+
+#endif  // SRC_HEADER_H_
@@ -0,0 +1,112 @@
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vips/vips.h>
+
+#include "intermediates.h"
+
+namespace sharp {
+
+  struct Intermediate {
+    std::string key;
+    int level;
+    VipsImage *image;
+    size_t bytes;
+  };
+
+  // Most recently used at the front, indexed by key then level
+  typedef std::list<Intermediate> Recency;
+  static Recency recency;
+  static std::map<std::pair<std::string, int>, Recency::iterator> index;
+
+  static GMutex mutex;
+  static size_t memory = 0;
+  static size_t current = 0;
+  static guint64 hits = 0;
+  static guint64 misses = 0;
+
+  /*
+    Evict least recently used intermediates until within budget. Caller must hold the mutex.
+  */
+  static void Evict() {
+    while (current > memory && !recency.empty()) {
+      Intermediate &oldest = recency.back();
+      index.erase(std::make_pair(oldest.key, oldest.level));
+      current -= oldest.bytes;
+      g_object_unref(oldest.image);
+      recency.pop_back();
+    }
+  }
+
+  /*
+    Bytes of an image's pixels when held in memory
+  */
+  static size_t SizeOf(VipsImage *image) {
+    return VIPS_IMAGE_SIZEOF_LINE(image) * image->Ysize;
+  }
+
+  bool IntermediatesEnabled() {
+    return memory > 0;
+  }
+
+  bool IntermediateFits(VipsImage *image) {
+    g_mutex_lock(&mutex);
+    bool const fits = SizeOf(image) <= memory;
+    g_mutex_unlock(&mutex);
+    return fits;
+  }
+
+  VipsImage* GetIntermediate(std::string const &key, int const shrink, int &level) {
+    VipsImage *image = NULL;
+    g_mutex_lock(&mutex);
+    // Find the largest level not exceeding shrink, which is the last entry for the key before shrink + 1
+    auto entry = index.lower_bound(std::make_pair(key, shrink + 1));
+    if (entry != index.begin()) {
+      --entry;
+      if (entry->first.first == key) {
+        Recency::iterator intermediate = entry->second;
+        recency.splice(recency.begin(), recency, intermediate);
+        image = intermediate->image;
+        g_object_ref(image);
+        level = intermediate->level;
+      }
+    }
+    if (image != NULL) {
+      hits++;
+    } else {
+      misses++;
+    }
+    g_mutex_unlock(&mutex);
+    return image;
+  }
+
+  void PutIntermediate(std::string const &key, int const level, VipsImage *image) {
+    size_t bytes = SizeOf(image);
+    g_mutex_lock(&mutex);
+    if (bytes <= memory && index.find(std::make_pair(key, level)) == index.end()) {
+      g_object_ref(image);
+      Intermediate intermediate = { key, level, image, bytes };
+      recency.push_front(intermediate);
+      index[std::make_pair(key, level)] = recency.begin();
+      current += bytes;
+      Evict();
+    }
+    g_mutex_unlock(&mutex);
+  }
+
+  IntermediatesStats GetIntermediatesStats() {
+    g_mutex_lock(&mutex);
+    IntermediatesStats stats = { memory, current, recency.size(), hits, misses };
+    g_mutex_unlock(&mutex);
+    return stats;
+  }
+
+  void SetIntermediatesMemory(size_t const newMemory) {
+    g_mutex_lock(&mutex);
+    memory = newMemory;
+    Evict();
+    g_mutex_unlock(&mutex);
+  }
+
+}  // namespace sharp
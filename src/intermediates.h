@@ -0,0 +1,54 @@
+#ifndef SRC_INTERMEDIATES_H_
+#define SRC_INTERMEDIATES_H_
+
+#include <cstddef>
+#include <string>
+
+#include <vips/vips.h>
+
+namespace sharp {
+
+  /*
+    Least recently used cache of decoded, colour-managed intermediate images, keyed by input identity and the
+    shrink-on-load factor used to decode them, within a memory budget. Disabled while the budget is zero.
+  */
+
+  /*
+    Is the cache enabled?
+  */
+  bool IntermediatesEnabled();
+
+  /*
+    Get a new reference to the cached intermediate of an input with the largest shrink-on-load factor
+    not exceeding shrink, setting level to that factor, or NULL when there is none.
+  */
+  VipsImage* GetIntermediate(std::string const &key, int const shrink, int &level);
+
+  /*
+    Would the image, once rendered into memory, fit within the budget? Checked before rendering, so an image
+    the cache would refuse keeps its lazy, sequential pipeline.
+  */
+  bool IntermediateFits(VipsImage *image);
+
+  /*
+    Add a memory image to the cache, which takes its own reference, evicting others to stay within budget.
+  */
+  void PutIntermediate(std::string const &key, int const level, VipsImage *image);
+
+  struct IntermediatesStats {
+    size_t memory;
+    size_t current;
+    size_t items;
+    guint64 hits;
+    guint64 misses;
+  };
+
+  /*
+    Get and set the memory budget, in bytes, and get the usage and hit statistics.
+  */
+  IntermediatesStats GetIntermediatesStats();
+  void SetIntermediatesMemory(size_t const memory);
+
+}  // namespace sharp
+
+#endif  // SRC_INTERMEDIATES_H_
@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <vector>
 #include <node.h>
+#include <node_buffer.h>
 #include <vips/vips.h>
 
 #include "nan.h"
 
 #include "common.h"
+#include "header.h"
+#include "pool.h"
 #include "metadata.h"
 
 using v8::Handle;
@@ -13,22 +18,35 @@ using v8::Object;
 using v8::Number;
 using v8::String;
 using v8::Boolean;
+using v8::Array;
 using v8::Function;
 using v8::Exception;
 
 using sharp::ImageType;
+using sharp::ImageHeader;
+using sharp::ImageLevel;
+using sharp::ParseHeader;
+using sharp::SignatureType;
+using sharp::ParseTiffLevels;
+using sharp::OpenSlideLevels;
 using sharp::DetermineImageType;
+using sharp::JoinChunks;
 using sharp::InitImage;
 using sharp::HasProfile;
 using sharp::HasAlpha;
 using sharp::ExifOrientation;
 using sharp::counterQueue;
+using sharp::Priority;
+using sharp::PriorityFromName;
+using sharp::QueueWorker;
+using sharp::PoolThreads;
 
 struct MetadataBaton {
   // Input
   std::string fileIn;
   void* bufferIn;
   size_t bufferInLength;
+  std::vector<std::pair<char*, size_t>> bufferInChunks;
   // Output
   std::string format;
   int width;
@@ -38,6 +56,7 @@ struct MetadataBaton {
   bool hasProfile;
   bool hasAlpha;
   int orientation;
+  std::vector<ImageLevel> levels;
   std::string err;
 
   MetadataBaton():
@@ -45,6 +64,135 @@ struct MetadataBaton {
     orientation(0) {}
 };
 
+/*
+  Name of the decoder used for an image type
+*/
+static std::string ImageTypeId(ImageType const imageType) {
+  std::string id;
+  switch (imageType) {
+    case ImageType::JPEG: id = "jpeg"; break;
+    case ImageType::PNG: id = "png"; break;
+    case ImageType::WEBP: id = "webp"; break;
+    case ImageType::TIFF: id = "tiff"; break;
+    case ImageType::MAGICK: id = "magick"; break;
+    case ImageType::OPENSLIDE: id = "openslide"; break;
+    case ImageType::UNKNOWN: id = "unknown"; break;
+  }
+  return id;
+}
+
+/*
+  Read the metadata of the input described by a baton, setting its err on failure.
+  Safe to call from many threads at once.
+*/
+static void ReadMetadata(MetadataBaton *baton) {
+  // Join chunks received from a Stream into a single buffer
+  char *joined = NULL;
+  if (!baton->bufferInChunks.empty() && baton->bufferInLength > 1) {
+    joined = JoinChunks(baton->bufferInChunks, baton->bufferInLength);
+    baton->bufferIn = joined;
+  }
+
+  // Read common formats straight from their header, without constructing a VipsImage
+  ImageHeader header;
+  bool parsed = (baton->bufferInLength > 1)
+    ? ParseHeader(baton->bufferIn, baton->bufferInLength, header)
+    : ParseHeader(baton->fileIn.c_str(), header);
+
+  ImageType imageType = ImageType::UNKNOWN;
+  VipsImage *image = NULL;
+  if (parsed) {
+    baton->format = ImageTypeId(header.type);
+    baton->width = header.width;
+    baton->height = header.height;
+    baton->space = header.space;
+    baton->channels = header.channels;
+    baton->hasProfile = header.hasProfile;
+    baton->hasAlpha = header.hasAlpha;
+    baton->orientation = header.orientation;
+  } else if (baton->bufferInLength > 1) {
+    // From buffer
+    imageType = DetermineImageType(baton->bufferIn, baton->bufferInLength);
+    if (imageType != ImageType::UNKNOWN) {
+      image = InitImage(baton->bufferIn, baton->bufferInLength, VIPS_ACCESS_RANDOM);
+      if (image == NULL) {
+        (baton->err).append("Input buffer has corrupt header");
+        imageType = ImageType::UNKNOWN;
+      }
+    } else {
+      (baton->err).append("Input buffer contains unsupported image format");
+    }
+  } else {
+    // From file
+    imageType = DetermineImageType(baton->fileIn.c_str());
+    if (imageType != ImageType::UNKNOWN) {
+      image = InitImage(baton->fileIn.c_str(), VIPS_ACCESS_RANDOM);
+      if (image == NULL) {
+        (baton->err).append("Input file has corrupt header");
+        imageType = ImageType::UNKNOWN;
+      }
+    } else {
+      (baton->err).append("Input file is of an unsupported image format");
+    }
+  }
+  if (image != NULL && imageType != ImageType::UNKNOWN) {
+    // Image type
+    baton->format = ImageTypeId(imageType);
+    // VipsImage attributes
+    baton->width = image->Xsize;
+    baton->height = image->Ysize;
+    baton->space = vips_enum_nick(VIPS_TYPE_INTERPRETATION, image->Type);
+    baton->channels = image->Bands;
+    baton->hasProfile = HasProfile(image);
+    // Derived attributes
+    baton->hasAlpha = HasAlpha(image);
+    baton->orientation = ExifOrientation(image);
+    if (imageType == ImageType::OPENSLIDE) {
+      baton->levels = OpenSlideLevels(image);
+    }
+    // Drop image reference
+    g_object_unref(image);
+  }
+  // Resolution levels of a multi-resolution TIFF, read from its image file directories
+  if (baton->err.empty() && baton->format == "tiff") {
+    baton->levels = (baton->bufferInLength > 1)
+      ? ParseTiffLevels(baton->bufferIn, baton->bufferInLength)
+      : ParseTiffLevels(baton->fileIn.c_str());
+  }
+  if (joined != NULL) {
+    delete[] joined;
+  }
+}
+
+/*
+  Create the metadata Object for JavaScript from a successfully read baton
+*/
+static Local<Object> MetadataInfo(MetadataBaton *baton) {
+  Local<Object> info = NanNew<Object>();
+  info->Set(NanNew<String>("format"), NanNew<String>(baton->format));
+  info->Set(NanNew<String>("width"), NanNew<Number>(baton->width));
+  info->Set(NanNew<String>("height"), NanNew<Number>(baton->height));
+  info->Set(NanNew<String>("space"), NanNew<String>(baton->space));
+  info->Set(NanNew<String>("channels"), NanNew<Number>(baton->channels));
+  info->Set(NanNew<String>("hasProfile"), NanNew<Boolean>(baton->hasProfile));
+  info->Set(NanNew<String>("hasAlpha"), NanNew<Boolean>(baton->hasAlpha));
+  if (baton->orientation > 0) {
+    info->Set(NanNew<String>("orientation"), NanNew<Number>(baton->orientation));
+  }
+  if (baton->levels.size() > 1) {
+    // Dimensions of each resolution level, from full resolution downwards
+    Local<Array> levels = NanNew<Array>(baton->levels.size());
+    for (size_t i = 0; i < baton->levels.size(); i++) {
+      Local<Object> level = NanNew<Object>();
+      level->Set(NanNew<String>("width"), NanNew<Number>(baton->levels[i].width));
+      level->Set(NanNew<String>("height"), NanNew<Number>(baton->levels[i].height));
+      levels->Set(i, level);
+    }
+    info->Set(NanNew<String>("levels"), levels);
+  }
+  return info;
+}
+
 class MetadataWorker : public NanAsyncWorker {
 
  public:
@@ -55,59 +203,10 @@ class MetadataWorker : public NanAsyncWorker {
     // Decrement queued task counter
     g_atomic_int_dec_and_test(&counterQueue);
 
-    ImageType imageType = ImageType::UNKNOWN;
-    VipsImage *image = NULL;
-    if (baton->bufferInLength > 1) {
-      // From buffer
-      imageType = DetermineImageType(baton->bufferIn, baton->bufferInLength);
-      if (imageType != ImageType::UNKNOWN) {
-        image = InitImage(baton->bufferIn, baton->bufferInLength, VIPS_ACCESS_RANDOM);
-        if (image == NULL) {
-          (baton->err).append("Input buffer has corrupt header");
-          imageType = ImageType::UNKNOWN;
-        }
-      } else {
-        (baton->err).append("Input buffer contains unsupported image format");
-      }
-    } else {
-      // From file
-      imageType = DetermineImageType(baton->fileIn.c_str());
-      if (imageType != ImageType::UNKNOWN) {
-        image = InitImage(baton->fileIn.c_str(), VIPS_ACCESS_RANDOM);
-        if (image == NULL) {
-          (baton->err).append("Input file has corrupt header");
-          imageType = ImageType::UNKNOWN;
-        }
-      } else {
-        (baton->err).append("Input file is of an unsupported image format");
-      }
-    }
-    if (image != NULL && imageType != ImageType::UNKNOWN) {
-      // Image type
-      switch (imageType) {
-        case ImageType::JPEG: baton->format = "jpeg"; break;
-        case ImageType::PNG: baton->format = "png"; break;
-        case ImageType::WEBP: baton->format = "webp"; break;
-        case ImageType::TIFF: baton->format = "tiff"; break;
-        case ImageType::MAGICK: baton->format = "magick"; break;
-        case ImageType::OPENSLIDE: baton->format = "openslide"; break;
-        case ImageType::UNKNOWN: break;
-      }
-      // VipsImage attributes
-      baton->width = image->Xsize;
-      baton->height = image->Ysize;
-      baton->space = vips_enum_nick(VIPS_TYPE_INTERPRETATION, image->Type);
-      baton->channels = image->Bands;
-      baton->hasProfile = HasProfile(image);
-      // Derived attributes
-      baton->hasAlpha = HasAlpha(image);
-      baton->orientation = ExifOrientation(image);
-      // Drop image reference
-      g_object_unref(image);
-    }
-    // Clean up
+    ReadMetadata(baton);
+
+    // Clean up, keeping per-thread state for the next task on this pool thread
     vips_error_clear();
-    vips_thread_shutdown();
   }
 
   void HandleOKCallback () {
@@ -119,18 +218,7 @@ class MetadataWorker : public NanAsyncWorker {
       argv[0] = Exception::Error(NanNew<String>(baton->err.data(), baton->err.size()));
     } else {
       // Metadata Object
-      Local<Object> info = NanNew<Object>();
-      info->Set(NanNew<String>("format"), NanNew<String>(baton->format));
-      info->Set(NanNew<String>("width"), NanNew<Number>(baton->width));
-      info->Set(NanNew<String>("height"), NanNew<Number>(baton->height));
-      info->Set(NanNew<String>("space"), NanNew<String>(baton->space));
-      info->Set(NanNew<String>("channels"), NanNew<Number>(baton->channels));
-      info->Set(NanNew<String>("hasProfile"), NanNew<Boolean>(baton->hasProfile));
-      info->Set(NanNew<String>("hasAlpha"), NanNew<Boolean>(baton->hasAlpha));
-      if (baton->orientation > 0) {
-        info->Set(NanNew<String>("orientation"), NanNew<Number>(baton->orientation));
-      }
-      argv[1] = info;
+      argv[1] = MetadataInfo(baton);
     }
     delete baton;
 
@@ -142,6 +230,68 @@ class MetadataWorker : public NanAsyncWorker {
   MetadataBaton* baton;
 };
 
+/*
+  Inputs of a batch, shared by the workers reading them, and the callback to run once all have been read
+*/
+struct MetadataBatch {
+  std::vector<MetadataBaton*> batons;
+  volatile int next;
+  int remaining;
+  NanCallback *callback;
+};
+
+class MetadataBatchWorker : public NanAsyncWorker {
+
+ public:
+  explicit MetadataBatchWorker(MetadataBatch *batch) : NanAsyncWorker(NULL), batch(batch) {}
+  ~MetadataBatchWorker() {}
+
+  void Execute() {
+    // Decrement queued task counter
+    g_atomic_int_dec_and_test(&counterQueue);
+
+    // Read inputs until none remain, each worker of the batch claiming the next unread input
+    int i;
+    while ((i = g_atomic_int_add(&batch->next, 1)) < static_cast<int>(batch->batons.size())) {
+      ReadMetadata(batch->batons[i]);
+    }
+
+    // Clean up, keeping per-thread state for the next task on this pool thread
+    vips_error_clear();
+  }
+
+  void HandleOKCallback () {
+    NanScope();
+
+    // The last worker of the batch to complete returns the results of all of them
+    batch->remaining--;
+    if (batch->remaining > 0) {
+      return;
+    }
+    // Array holding the metadata Object or Error for each input, in order
+    Local<Array> results = NanNew<Array>(batch->batons.size());
+    for (size_t i = 0; i < batch->batons.size(); i++) {
+      MetadataBaton *baton = batch->batons[i];
+      if (!baton->err.empty()) {
+        results->Set(i, Exception::Error(NanNew<String>(baton->err.data(), baton->err.size())));
+      } else {
+        results->Set(i, MetadataInfo(baton));
+      }
+      delete baton;
+    }
+    NanCallback *callback = batch->callback;
+    delete batch;
+
+    // Return to JavaScript
+    Handle<Value> argv[2] = { NanNull(), results };
+    callback->Call(2, argv);
+    delete callback;
+  }
+
+ private:
+  MetadataBatch *batch;
+};
+
 /*
   metadata(options, callback)
 */
@@ -154,19 +304,111 @@ NAN_METHOD(metadata) {
 
   // Input filename
   baton->fileIn = *String::Utf8Value(options->Get(NanNew<String>("fileIn"))->ToString());
-  // Input Buffer object
-  if (options->Get(NanNew<String>("bufferIn"))->IsObject()) {
-    Local<Object> buffer = options->Get(NanNew<String>("bufferIn"))->ToObject();
+  // Input Buffer object, or Array of Buffer chunks from a Stream
+  Local<Object> buffer;
+  if (options->Get(NanNew<String>("bufferIn"))->IsArray()) {
+    buffer = options->Get(NanNew<String>("bufferIn"))->ToObject();
+    Local<Array> chunks = Local<Array>::Cast(buffer);
+    for (unsigned int i = 0; i < chunks->Length(); i++) {
+      Local<Object> chunk = chunks->Get(i)->ToObject();
+      baton->bufferInChunks.push_back(std::make_pair(node::Buffer::Data(chunk), node::Buffer::Length(chunk)));
+      baton->bufferInLength += node::Buffer::Length(chunk);
+    }
+  } else if (options->Get(NanNew<String>("bufferIn"))->IsObject()) {
+    buffer = options->Get(NanNew<String>("bufferIn"))->ToObject();
     baton->bufferInLength = node::Buffer::Length(buffer);
     baton->bufferIn = node::Buffer::Data(buffer);
   }
 
   // Join queue for worker thread
   NanCallback *callback = new NanCallback(args[1].As<v8::Function>());
-  NanAsyncQueueWorker(new MetadataWorker(callback, baton));
+  MetadataWorker *worker = new MetadataWorker(callback, baton);
+  if (baton->bufferInLength > 0) {
+    // Prevent garbage collection of the input Buffer, or chunks thereof, while in use
+    worker->SaveToPersistent("bufferIn", buffer);
+  }
+  // Reading metadata is cheap, so when shortest-job-first is enabled it runs ahead of resizing with the same priority
+  Priority priority = PriorityFromName(*String::Utf8Value(options->Get(NanNew<String>("priority"))->ToString()));
+  QueueWorker(worker, priority, 0.0, 0);
 
   // Increment queued task counter
   g_atomic_int_inc(&counterQueue);
 
   NanReturnUndefined();
 }
+
+/*
+  metadataBatch(inputs, callback)
+  Each input is an Object with either a fileIn filename or a bufferIn Buffer
+*/
+NAN_METHOD(metadataBatch) {
+  NanScope();
+
+  Local<Array> inputs = Local<Array>::Cast(args[0]);
+  std::vector<MetadataBaton*> batons;
+  for (unsigned int i = 0; i < inputs->Length(); i++) {
+    Local<Object> input = inputs->Get(i)->ToObject();
+    MetadataBaton *baton = new MetadataBaton;
+    if (input->Get(NanNew<String>("bufferIn"))->IsObject()) {
+      Local<Object> buffer = input->Get(NanNew<String>("bufferIn"))->ToObject();
+      baton->bufferInLength = node::Buffer::Length(buffer);
+      baton->bufferIn = node::Buffer::Data(buffer);
+    } else {
+      baton->fileIn = *String::Utf8Value(input->Get(NanNew<String>("fileIn"))->ToString());
+    }
+    batons.push_back(baton);
+  }
+
+  // Spread the inputs across workers of the pool, up to one per thread, so a batch is bound by the same limits
+  // as any other task and concurrent batches share the pool's threads rather than adding their own
+  MetadataBatch *batch = new MetadataBatch;
+  batch->batons = batons;
+  batch->next = 0;
+  batch->remaining = std::max(std::min(static_cast<int>(batons.size()), PoolThreads()), 1);
+  batch->callback = new NanCallback(args[1].As<v8::Function>());
+  for (int i = batch->remaining; i > 0; i--) {
+    // Join queue for worker thread
+    MetadataBatchWorker *worker = new MetadataBatchWorker(batch);
+    // Prevent garbage collection of input Buffers while in use
+    worker->SaveToPersistent("inputs", inputs);
+    QueueWorker(worker, Priority::NORMAL, 0.0, 0);
+
+    // Increment queued task counter
+    g_atomic_int_inc(&counterQueue);
+  }
+
+  NanReturnUndefined();
+}
+
+/*
+  sniff(buffer)
+  Synchronously determine the format and, if the header is complete, dimensions of partial JPEG, PNG, WebP or TIFF input,
+  without calling libvips
+*/
+NAN_METHOD(sniff) {
+  NanScope();
+
+  Local<Object> buffer = args[0]->ToObject();
+  void *data = node::Buffer::Data(buffer);
+  size_t length = node::Buffer::Length(buffer);
+
+  int width = 0;
+  int height = 0;
+  ImageType imageType = ImageType::UNKNOWN;
+  ImageHeader parsed;
+  if (ParseHeader(data, length, parsed)) {
+    imageType = parsed.type;
+    width = parsed.width;
+    height = parsed.height;
+  } else {
+    // Incomplete or not parsed by this module, so dimensions remain unknown until the input is processed.
+    // libvips is not asked, as it could write to its error buffer, shared with worker threads.
+    imageType = SignatureType(data, length);
+  }
+
+  Local<Object> header = NanNew<Object>();
+  header->Set(NanNew<String>("format"), NanNew<String>(ImageTypeId(imageType)));
+  header->Set(NanNew<String>("width"), NanNew<Number>(width));
+  header->Set(NanNew<String>("height"), NanNew<Number>(height));
+  NanReturnValue(header);
+}
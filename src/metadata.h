@@ -4,5 +4,7 @@
 #include "nan.h"
 
 NAN_METHOD(metadata);
+NAN_METHOD(metadataBatch);
+NAN_METHOD(sniff);
 
 #endif  // SRC_METADATA_H_
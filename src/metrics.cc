@@ -0,0 +1,181 @@
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <node.h>
+#include <vips/vips.h>
+
+#include "nan.h"
+
+#include "common.h"
+#include "metrics.h"
+
+using v8::Local;
+using v8::Object;
+using v8::Array;
+using v8::Number;
+using v8::String;
+
+namespace sharp {
+
+  /*
+    Counters updated by worker threads with relaxed atomic operations, so never blocking them.
+    A snapshot taken while tasks complete may therefore mix counts from either side of a task.
+  */
+  typedef std::atomic<uint64_t> Counter;
+
+  static uint64_t Read(Counter &counter, bool const reset) {
+    return reset ? counter.exchange(0, std::memory_order_relaxed) : counter.load(std::memory_order_relaxed);
+  }
+
+  // Upper bounds, in milliseconds, of latency histogram buckets, with a final bucket for anything slower
+  static double const bounds[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000 };
+  static size_t const boundsCount = sizeof(bounds) / sizeof(bounds[0]);
+
+  struct Histogram {
+    Counter buckets[boundsCount + 1];
+    Counter count;
+    Counter sum;
+
+    void Add(gint64 const microseconds) {
+      size_t bucket = 0;
+      while (bucket < boundsCount && microseconds > bounds[bucket] * 1000) {
+        bucket++;
+      }
+      buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(static_cast<uint64_t>(microseconds), std::memory_order_relaxed);
+    }
+  };
+
+  struct FormatCounters {
+    Counter tasks;
+    Counter errors;
+    Counter bytes;
+    Counter pixels;
+  };
+
+  static Histogram queueLatency;
+  static Histogram processLatency;
+  static Histogram totalLatency;
+
+  // Input formats, indexed by ImageType
+  static char const *inputFormats[] = { "unknown", "jpeg", "png", "webp", "tiff", "magick", "openslide" };
+  static size_t const inputFormatsCount = sizeof(inputFormats) / sizeof(inputFormats[0]);
+  static FormatCounters inputs[inputFormatsCount];
+
+  // Output formats, as named by the outputFormat of a ResizeBaton
+  static char const *outputFormats[] = { "jpeg", "png", "webp", "tiff", "dz", "raw" };
+  static size_t const outputFormatsCount = sizeof(outputFormats) / sizeof(outputFormats[0]);
+  static FormatCounters outputs[outputFormatsCount];
+
+  // JPEG and WebP inputs, which support shrink-on-load, and how many of these used it
+  static Counter shrinkOnLoadEligible;
+  static Counter shrinkOnLoadHits;
+
+  void RecordTask(ImageType const type, bool const ok, gint64 const queueTime, gint64 const processTime,
+    guint64 const bytes, guint64 const pixels, int const shrinkOnLoad) {
+    queueLatency.Add(queueTime);
+    processLatency.Add(processTime);
+    totalLatency.Add(queueTime + processTime);
+    FormatCounters &input = inputs[static_cast<size_t>(type) < inputFormatsCount ? static_cast<size_t>(type) : 0];
+    input.tasks.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+      input.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    input.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    input.pixels.fetch_add(pixels, std::memory_order_relaxed);
+    if (ok && (type == ImageType::JPEG || type == ImageType::WEBP)) {
+      shrinkOnLoadEligible.fetch_add(1, std::memory_order_relaxed);
+      if (shrinkOnLoad > 1) {
+        shrinkOnLoadHits.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void RecordOutput(std::string const &format, guint64 const bytes, guint64 const pixels) {
+    for (size_t i = 0; i < outputFormatsCount; i++) {
+      if (format == outputFormats[i]) {
+        outputs[i].tasks.fetch_add(1, std::memory_order_relaxed);
+        outputs[i].bytes.fetch_add(bytes, std::memory_order_relaxed);
+        outputs[i].pixels.fetch_add(pixels, std::memory_order_relaxed);
+        break;
+      }
+    }
+  }
+
+  /*
+    Snapshot of a latency histogram: count, sum (ms) and bucket counts, the last being slower than all bounds
+  */
+  static Local<Object> HistogramSnapshot(Histogram &histogram, bool const reset) {
+    Local<Object> snapshot = NanNew<Object>();
+    Local<Array> counts = NanNew<Array>(boundsCount + 1);
+    for (size_t i = 0; i <= boundsCount; i++) {
+      counts->Set(i, NanNew<Number>(static_cast<double>(Read(histogram.buckets[i], reset))));
+    }
+    snapshot->Set(NanNew<String>("count"), NanNew<Number>(static_cast<double>(Read(histogram.count, reset))));
+    snapshot->Set(NanNew<String>("sum"), NanNew<Number>(static_cast<double>(Read(histogram.sum, reset)) / 1000.0));
+    snapshot->Set(NanNew<String>("counts"), counts);
+    return snapshot;
+  }
+
+  /*
+    Snapshot of per-format counters, omitting formats not yet seen
+  */
+  static Local<Object> FormatsSnapshot(FormatCounters *counters, char const **names, size_t const count,
+    bool const withErrors, bool const reset) {
+    Local<Object> snapshot = NanNew<Object>();
+    for (size_t i = 0; i < count; i++) {
+      uint64_t tasks = Read(counters[i].tasks, reset);
+      uint64_t errors = Read(counters[i].errors, reset);
+      uint64_t bytes = Read(counters[i].bytes, reset);
+      uint64_t pixels = Read(counters[i].pixels, reset);
+      if (tasks > 0) {
+        Local<Object> format = NanNew<Object>();
+        format->Set(NanNew<String>("count"), NanNew<Number>(static_cast<double>(tasks)));
+        if (withErrors) {
+          format->Set(NanNew<String>("errors"), NanNew<Number>(static_cast<double>(errors)));
+        }
+        format->Set(NanNew<String>("bytes"), NanNew<Number>(static_cast<double>(bytes)));
+        format->Set(NanNew<String>("pixels"), NanNew<Number>(static_cast<double>(pixels)));
+        snapshot->Set(NanNew<String>(names[i]), format);
+      }
+    }
+    return snapshot;
+  }
+
+}  // namespace sharp
+
+/*
+  Get, and optionally reset, process-wide metrics of resize tasks
+*/
+NAN_METHOD(metrics) {
+  NanScope();
+
+  bool reset = args[0]->BooleanValue();
+  Local<Object> metrics = NanNew<Object>();
+  // Latency histograms
+  Local<Array> bounds = NanNew<Array>(sharp::boundsCount);
+  for (size_t i = 0; i < sharp::boundsCount; i++) {
+    bounds->Set(i, NanNew<Number>(sharp::bounds[i]));
+  }
+  Local<Object> latency = NanNew<Object>();
+  latency->Set(NanNew<String>("bounds"), bounds);
+  latency->Set(NanNew<String>("queue"), sharp::HistogramSnapshot(sharp::queueLatency, reset));
+  latency->Set(NanNew<String>("process"), sharp::HistogramSnapshot(sharp::processLatency, reset));
+  latency->Set(NanNew<String>("total"), sharp::HistogramSnapshot(sharp::totalLatency, reset));
+  metrics->Set(NanNew<String>("latency"), latency);
+  // Counters by format
+  metrics->Set(NanNew<String>("input"),
+    sharp::FormatsSnapshot(sharp::inputs, sharp::inputFormats, sharp::inputFormatsCount, TRUE, reset));
+  metrics->Set(NanNew<String>("output"),
+    sharp::FormatsSnapshot(sharp::outputs, sharp::outputFormats, sharp::outputFormatsCount, FALSE, reset));
+  // Shrink-on-load
+  double eligible = static_cast<double>(sharp::Read(sharp::shrinkOnLoadEligible, reset));
+  double hits = static_cast<double>(sharp::Read(sharp::shrinkOnLoadHits, reset));
+  Local<Object> shrinkOnLoad = NanNew<Object>();
+  shrinkOnLoad->Set(NanNew<String>("eligible"), NanNew<Number>(eligible));
+  shrinkOnLoad->Set(NanNew<String>("hits"), NanNew<Number>(hits));
+  shrinkOnLoad->Set(NanNew<String>("rate"), NanNew<Number>(eligible > 0 ? hits / eligible : 0.0));
+  metrics->Set(NanNew<String>("shrinkOnLoad"), shrinkOnLoad);
+  NanReturnValue(metrics);
+}
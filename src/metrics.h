@@ -0,0 +1,28 @@
+#ifndef SRC_METRICS_H_
+#define SRC_METRICS_H_
+
+#include <string>
+
+#include "nan.h"
+
+#include "common.h"
+
+namespace sharp {
+
+  /*
+    Record a completed task, successful or not, by the format of its input.
+    Times are in microseconds. Called from worker threads without locking.
+  */
+  void RecordTask(ImageType const type, bool const ok, gint64 const queueTime, gint64 const processTime,
+    guint64 const bytes, guint64 const pixels, int const shrinkOnLoad);
+
+  /*
+    Record an output image by its format. Called from worker threads without locking.
+  */
+  void RecordOutput(std::string const &format, guint64 const bytes, guint64 const pixels);
+
+}  // namespace sharp
+
+NAN_METHOD(metrics);
+
+#endif  // SRC_METRICS_H_
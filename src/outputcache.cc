@@ -0,0 +1,103 @@
+#include <list>
+#include <map>
+#include <string>
+#include <vips/vips.h>
+
+#include "outputcache.h"
+
+namespace sharp {
+
+  struct Entry {
+    std::string key;
+    GBytes *data;
+    std::string format;
+    int width;
+    int height;
+    int cropOffsetLeft;
+    int cropOffsetTop;
+  };
+
+  // Most recently used at the front, indexed by key
+  typedef std::list<Entry> Recency;
+  static Recency recency;
+  static std::map<std::string, Recency::iterator> index;
+
+  static GMutex mutex;
+  static size_t memory = 0;
+  static size_t current = 0;
+  static double hits = 0;
+  static double misses = 0;
+
+  /*
+    Memory used by an entry, counting its key as well as its data
+  */
+  static size_t EntrySize(Entry const &entry) {
+    return entry.key.size() + g_bytes_get_size(entry.data);
+  }
+
+  /*
+    Evict least recently used outputs until within budget. Caller must hold the mutex.
+  */
+  static void Evict() {
+    while (current > memory && !recency.empty()) {
+      Entry &oldest = recency.back();
+      index.erase(oldest.key);
+      current -= EntrySize(oldest);
+      g_bytes_unref(oldest.data);
+      recency.pop_back();
+    }
+  }
+
+  bool OutputCacheEnabled() {
+    return memory > 0;
+  }
+
+  bool GetOutput(std::string const &key, CachedOutput &output) {
+    g_mutex_lock(&mutex);
+    auto entry = index.find(key);
+    bool const found = entry != index.end();
+    if (found) {
+      hits++;
+      recency.splice(recency.begin(), recency, entry->second);
+      Entry const &cached = *entry->second;
+      output.data = g_bytes_ref(cached.data);
+      output.format = cached.format;
+      output.width = cached.width;
+      output.height = cached.height;
+      output.cropOffsetLeft = cached.cropOffsetLeft;
+      output.cropOffsetTop = cached.cropOffsetTop;
+    } else {
+      misses++;
+    }
+    g_mutex_unlock(&mutex);
+    return found;
+  }
+
+  void PutOutput(std::string const &key, CachedOutput const &output) {
+    g_mutex_lock(&mutex);
+    if (key.size() + g_bytes_get_size(output.data) <= memory && index.find(key) == index.end()) {
+      Entry entry = { key, g_bytes_ref(output.data), output.format,
+        output.width, output.height, output.cropOffsetLeft, output.cropOffsetTop };
+      recency.push_front(entry);
+      index[key] = recency.begin();
+      current += EntrySize(entry);
+      Evict();
+    }
+    g_mutex_unlock(&mutex);
+  }
+
+  OutputCacheStats GetOutputCacheStats() {
+    g_mutex_lock(&mutex);
+    OutputCacheStats stats = { memory, current, recency.size(), hits, misses };
+    g_mutex_unlock(&mutex);
+    return stats;
+  }
+
+  void SetOutputCacheMemory(size_t const newMemory) {
+    g_mutex_lock(&mutex);
+    memory = newMemory;
+    Evict();
+    g_mutex_unlock(&mutex);
+  }
+
+}  // namespace sharp
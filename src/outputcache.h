@@ -0,0 +1,58 @@
+#ifndef SRC_OUTPUTCACHE_H_
+#define SRC_OUTPUTCACHE_H_
+
+#include <cstddef>
+#include <string>
+
+#include <vips/vips.h>
+
+namespace sharp {
+
+  /*
+    Least recently used cache of encoded output images, keyed by the identity of the input and a canonical form
+    of the options used to process it, within a memory budget. Disabled while the budget is zero.
+    Accessed by worker threads, so guarded by a mutex. Encoded data is held by reference count, shared with
+    the Buffers returned to JavaScript, so is never copied.
+  */
+
+  struct CachedOutput {
+    GBytes *data;
+    std::string format;
+    int width;
+    int height;
+    int cropOffsetLeft;
+    int cropOffsetTop;
+  };
+
+  /*
+    Is the cache enabled?
+  */
+  bool OutputCacheEnabled();
+
+  /*
+    Find the output for a key, setting data to a new reference the caller must release with g_bytes_unref.
+  */
+  bool GetOutput(std::string const &key, CachedOutput &output);
+
+  /*
+    Add an output to the cache, which takes its own reference to the data, evicting others to stay within budget.
+  */
+  void PutOutput(std::string const &key, CachedOutput const &output);
+
+  struct OutputCacheStats {
+    size_t memory;
+    size_t current;
+    size_t items;
+    double hits;
+    double misses;
+  };
+
+  /*
+    Get and set the memory budget, in bytes, and get the usage and hit statistics.
+  */
+  OutputCacheStats GetOutputCacheStats();
+  void SetOutputCacheMemory(size_t const memory);
+
+}  // namespace sharp
+
+#endif  // SRC_OUTPUTCACHE_H_
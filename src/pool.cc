@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <uv.h>
+#include <vips/vips.h>
+
+#include "nan.h"
+
+#include "pool.h"
+
+namespace sharp {
+
+  struct Job {
+    NanAsyncWorker *worker;
+    Priority priority;
+    double rank;
+    size_t memory;
+    guint64 sequence;
+  };
+
+  // Threads wait on this for queued jobs, or to find they are surplus
+  static GMutex mutex;
+  static GCond available;
+
+  // Queued jobs, held as a heap with the next to run at the front
+  static std::vector<Job> queue;
+  static guint64 sequence = 0;
+  static bool shortestJobFirst = FALSE;
+
+  // Shortest-job-first ranks jobs by the log2 of their cost plus their sequence number scaled by this, so that a
+  // job waits for at most this many later arrivals for each doubling of cost between it and them
+  static double const agingArrivals = 8.0;
+  // Moving average of the log2 of recent known costs, ranking jobs whose cost is unknown when queued
+  static double typicalLogCost = 0.0;
+
+  // Workers whose Execute has finished, awaiting completion on the JavaScript thread
+  static std::vector<NanAsyncWorker*> completed;
+  static uv_async_t async;
+
+  // Number of threads running and wanted
+  static int threads = 0;
+  static int wantedThreads = 0;
+
+  // Admission control: estimated memory of running jobs, the limit of this, and the limit of queued jobs, zero for none
+  static size_t memoryAdmitted = 0;
+  static size_t memoryBudget = 0;
+  static size_t queueDepth = 0;
+  // Number of running workers waiting in AdmitMemory
+  static int admitting = 0;
+
+  // Number of queued, running and completed workers, accessed only on the JavaScript thread
+  static int outstanding = 0;
+
+  /*
+    Heap ordering: true when job a should run after job b
+  */
+  static bool RunsAfter(Job const &a, Job const &b) {
+    if (a.priority != b.priority) {
+      return a.priority > b.priority;
+    }
+    if (shortestJobFirst && a.rank != b.rank) {
+      return a.rank > b.rank;
+    }
+    return a.sequence > b.sequence;
+  }
+
+  /*
+    Can the next job start within the memory budget? Caller must hold the mutex.
+    A job estimated to need more than the whole budget can start only when no others are running.
+    Running workers waiting for their memory to be admitted go first.
+  */
+  static bool NextJobFits() {
+    return !queue.empty() && (
+      memoryBudget == 0 || memoryAdmitted == 0 || (admitting == 0 && memoryAdmitted + queue.front().memory <= memoryBudget)
+    );
+  }
+
+  /*
+    Pool thread: run queued jobs until there are more threads than wanted.
+    Jobs wait in the queue while starting the next would exceed the memory budget.
+    libvips' per-thread state is kept between jobs and released only when the thread exits.
+  */
+  static gpointer PoolThread(gpointer data) {
+    g_mutex_lock(&mutex);
+    while (TRUE) {
+      while (!NextJobFits() && threads <= wantedThreads) {
+        g_cond_wait(&available, &mutex);
+      }
+      if (threads > wantedThreads) {
+        break;
+      }
+      std::pop_heap(queue.begin(), queue.end(), RunsAfter);
+      Job job = queue.back();
+      queue.pop_back();
+      memoryAdmitted += job.memory;
+      g_mutex_unlock(&mutex);
+
+      job.worker->Execute();
+
+      g_mutex_lock(&mutex);
+      memoryAdmitted -= job.memory;
+      completed.push_back(job.worker);
+      uv_async_send(&async);
+      // Memory has been released, so waiting jobs may now fit
+      g_cond_broadcast(&available);
+    }
+    threads--;
+    g_mutex_unlock(&mutex);
+    vips_thread_shutdown();
+    return NULL;
+  }
+
+  /*
+    Start threads until there are as many as wanted. Caller must hold the mutex.
+  */
+  static void StartThreads() {
+    while (threads < wantedThreads) {
+      g_thread_unref(g_thread_new("sharp", PoolThread, NULL));
+      threads++;
+    }
+  }
+
+  /*
+    Complete finished workers on the JavaScript thread, calling back with their results
+  */
+  static NAUV_WORK_CB(CompleteWorkers) {
+    std::vector<NanAsyncWorker*> workers;
+    g_mutex_lock(&mutex);
+    workers.swap(completed);
+    g_mutex_unlock(&mutex);
+    for (NanAsyncWorker *worker : workers) {
+      worker->WorkComplete();
+      worker->Destroy();
+      outstanding--;
+    }
+    if (outstanding == 0) {
+      // Allow the event loop to exit while the pool is idle
+      uv_unref(reinterpret_cast<uv_handle_t*>(&async));
+    }
+  }
+
+  /*
+    Initialise on first use, from the JavaScript thread.
+    The default size matches libuv's thread pool, which previously ran all tasks.
+  */
+  static void Initialise() {
+    static bool initialised = FALSE;
+    if (!initialised) {
+      g_mutex_init(&mutex);
+      g_cond_init(&available);
+      uv_async_init(uv_default_loop(), &async, CompleteWorkers);
+      uv_unref(reinterpret_cast<uv_handle_t*>(&async));
+      char const *size = g_getenv("UV_THREADPOOL_SIZE");
+      wantedThreads = (size != NULL && atoi(size) > 0) ? atoi(size) : 4;
+      initialised = TRUE;
+    }
+  }
+
+  Priority PriorityFromName(std::string const &name) {
+    Priority priority = Priority::NORMAL;
+    if (name == "high") {
+      priority = Priority::HIGH;
+    } else if (name == "low") {
+      priority = Priority::LOW;
+    }
+    return priority;
+  }
+
+  /*
+    Count a worker that will complete on the JavaScript thread, keeping the event loop alive until it does
+  */
+  static void AddOutstanding() {
+    if (outstanding == 0) {
+      uv_ref(reinterpret_cast<uv_handle_t*>(&async));
+    }
+    outstanding++;
+  }
+
+  /*
+    Update the typical cost from a known cost. Caller must hold the mutex.
+  */
+  static void UpdateTypicalCost(double const cost) {
+    if (cost > 0.0) {
+      typicalLogCost = (typicalLogCost == 0.0) ? std::log2(cost) : 0.875 * typicalLogCost + 0.125 * std::log2(cost);
+    }
+  }
+
+  void QueueWorker(NanAsyncWorker *worker, Priority const priority, double const cost, size_t const memory) {
+    Initialise();
+    AddOutstanding();
+    g_mutex_lock(&mutex);
+    StartThreads();
+    double logCost = typicalLogCost;
+    if (cost >= 0.0) {
+      UpdateTypicalCost(cost);
+      logCost = std::log2(std::max(cost, 1.0));
+    }
+    Job job = { worker, priority, logCost + static_cast<double>(sequence) / agingArrivals, memory, sequence };
+    sequence++;
+    queue.push_back(job);
+    std::push_heap(queue.begin(), queue.end(), RunsAfter);
+    g_cond_signal(&available);
+    g_mutex_unlock(&mutex);
+  }
+
+  void RecordCost(double const cost) {
+    g_mutex_lock(&mutex);
+    UpdateTypicalCost(cost);
+    g_mutex_unlock(&mutex);
+  }
+
+  void AdmitMemory(size_t const memory) {
+    g_mutex_lock(&mutex);
+    admitting++;
+    while (memoryBudget > 0 && memoryAdmitted > 0 && memoryAdmitted + memory > memoryBudget) {
+      g_cond_wait(&available, &mutex);
+    }
+    admitting--;
+    memoryAdmitted += memory;
+    // Queued jobs held back while waiting may now start, if they fit
+    g_cond_broadcast(&available);
+    g_mutex_unlock(&mutex);
+  }
+
+  void ReleaseMemory(size_t const memory) {
+    g_mutex_lock(&mutex);
+    memoryAdmitted -= memory;
+    g_cond_broadcast(&available);
+    g_mutex_unlock(&mutex);
+  }
+
+  bool QueueFull() {
+    g_mutex_lock(&mutex);
+    bool full = queueDepth > 0 && queue.size() >= queueDepth;
+    g_mutex_unlock(&mutex);
+    return full;
+  }
+
+  void CompleteWorker(NanAsyncWorker *worker) {
+    Initialise();
+    AddOutstanding();
+    g_mutex_lock(&mutex);
+    completed.push_back(worker);
+    uv_async_send(&async);
+    g_mutex_unlock(&mutex);
+  }
+
+  int PoolThreads() {
+    Initialise();
+    return wantedThreads;
+  }
+
+  void SetPoolThreads(int const size) {
+    Initialise();
+    g_mutex_lock(&mutex);
+    wantedThreads = size;
+    StartThreads();
+    // Wake idle threads so any surplus exit
+    g_cond_broadcast(&available);
+    g_mutex_unlock(&mutex);
+  }
+
+  bool ShortestJobFirst() {
+    return shortestJobFirst;
+  }
+
+  void SetShortestJobFirst(bool const enable) {
+    Initialise();
+    g_mutex_lock(&mutex);
+    if (enable != shortestJobFirst) {
+      shortestJobFirst = enable;
+      std::make_heap(queue.begin(), queue.end(), RunsAfter);
+    }
+    g_mutex_unlock(&mutex);
+  }
+
+  size_t MemoryAdmitted() {
+    g_mutex_lock(&mutex);
+    size_t memory = memoryAdmitted;
+    g_mutex_unlock(&mutex);
+    return memory;
+  }
+
+  size_t MemoryBudget() {
+    return memoryBudget;
+  }
+
+  size_t QueueDepth() {
+    return queueDepth;
+  }
+
+  void SetAdmission(size_t const memory, size_t const depth) {
+    Initialise();
+    g_mutex_lock(&mutex);
+    memoryBudget = memory;
+    queueDepth = depth;
+    // A larger budget may allow waiting jobs to start
+    g_cond_broadcast(&available);
+    g_mutex_unlock(&mutex);
+  }
+
+}  // namespace sharp
@@ -0,0 +1,80 @@
+#ifndef SRC_POOL_H_
+#define SRC_POOL_H_
+
+#include <cstddef>
+#include <string>
+
+#include "nan.h"
+
+namespace sharp {
+
+  enum class Priority {
+    HIGH,
+    NORMAL,
+    LOW
+  };
+
+  /*
+    Convert the name of a priority, one of "high", "normal" or "low", to its enum value.
+  */
+  Priority PriorityFromName(std::string const &name);
+
+  /*
+    Queue a worker to run on a thread of this module's own pool, rather than libuv's, which is shared with fs, dns etc.
+    Queued workers run in order of priority then, within a priority, arrival or, with shortest-job-first, ascending cost
+    aged by arrival so that costly workers are not starved. A negative cost is unknown, and taken as typical of recent
+    workers. A worker waits while its estimated memory, in bytes, would take the total of those running beyond the budget.
+    Must be called from the JavaScript thread, where the worker's callback will also run.
+  */
+  void QueueWorker(NanAsyncWorker *worker, Priority const priority, double const cost, size_t const memory);
+
+  /*
+    Record the cost of a worker, queued with an unknown cost, once known, for the typical cost of later such workers.
+  */
+  void RecordCost(double const cost);
+
+  /*
+    For a running worker queued with an unknown memory estimate, wait until the memory it has since estimated fits
+    within the budget alongside that of other running workers, then count it as admitted until released.
+    Queued workers do not start while a running worker waits.
+  */
+  void AdmitMemory(size_t const memory);
+  void ReleaseMemory(size_t const memory);
+
+  /*
+    Is the queue at its maximum depth, such that further workers should be rejected?
+  */
+  bool QueueFull();
+
+  /*
+    Complete a worker on the JavaScript thread without running it, such as one rejected by a full queue.
+  */
+  void CompleteWorker(NanAsyncWorker *worker);
+
+  /*
+    Get and set the number of threads in the pool.
+  */
+  int PoolThreads();
+  void SetPoolThreads(int const threads);
+
+  /*
+    Get and set whether queued workers of the same priority run in order of ascending cost.
+  */
+  bool ShortestJobFirst();
+  void SetShortestJobFirst(bool const shortestJobFirst);
+
+  /*
+    Get the estimated memory, in bytes, of running workers.
+  */
+  size_t MemoryAdmitted();
+
+  /*
+    Get and set the memory budget, in bytes, and maximum queue depth used for admission control, zero for unlimited.
+  */
+  size_t MemoryBudget();
+  size_t QueueDepth();
+  void SetAdmission(size_t const memory, size_t const depth);
+
+}  // namespace sharp
+
+#endif  // SRC_POOL_H_
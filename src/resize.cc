@@ -1,14 +1,31 @@
 #include <tuple>
+#include <map>
+#include <string>
+#include <vector>
 #include <algorithm>
+#include <climits>
 #include <cmath>
+#include <limits>
 #include <node.h>
 #include <node_buffer.h>
 #include <vips/vips.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 #include "nan.h"
 
 #include "common.h"
+#include "convolve.h"
+#include "header.h"
+#include "intermediates.h"
+#include "metrics.h"
+#include "outputcache.h"
+#include "pool.h"
 #include "resize.h"
+#include "resources.h"
+#include "smartcrop.h"
 
 using v8::Handle;
 using v8::Local;
@@ -16,6 +33,7 @@ using v8::Value;
 using v8::Object;
 using v8::Integer;
 using v8::Uint32;
+using v8::Number;
 using v8::String;
 using v8::Array;
 using v8::Function;
@@ -23,17 +41,61 @@ using v8::Exception;
 
 using sharp::ImageType;
 using sharp::DetermineImageType;
+using sharp::JoinChunks;
+using sharp::HashData;
+using sharp::IntermediatesEnabled;
+using sharp::GetIntermediate;
+using sharp::IntermediateFits;
+using sharp::PutIntermediate;
 using sharp::InitImage;
+using sharp::ImageLevel;
+using sharp::ParseTiffLevels;
+using sharp::OpenSlideLevels;
+using sharp::ChooseLevel;
 using sharp::InterpolatorWindowSize;
+using sharp::GetInterpolator;
+using sharp::GetGaussian;
+using sharp::GetMildBlur;
+using sharp::GetMildSharpen;
+using sharp::Convolve;
+using sharp::CropStrategy;
+using sharp::IsCropStrategy;
+using sharp::CanScoreCrop;
+using sharp::ChooseCrop;
+using sharp::CalculateCropAround;
+using sharp::ConvolveSeparable;
 using sharp::HasProfile;
+using sharp::HasSrgbProfile;
 using sharp::HasAlpha;
+using sharp::CanNormaliseInPlace;
+using sharp::NormaliseInPlace;
 using sharp::ExifOrientation;
 using sharp::IsJpeg;
 using sharp::IsPng;
 using sharp::IsWebp;
 using sharp::IsTiff;
 using sharp::IsDz;
+using sharp::IsDzZip;
 using sharp::counterProcess;
+using sharp::counterRejected;
+using sharp::ImageHeader;
+using sharp::ParseHeader;
+using sharp::RecordTask;
+using sharp::RecordOutput;
+using sharp::CachedOutput;
+using sharp::OutputCacheEnabled;
+using sharp::GetOutput;
+using sharp::PutOutput;
+using sharp::Priority;
+using sharp::PriorityFromName;
+using sharp::QueueWorker;
+using sharp::QueueFull;
+using sharp::CompleteWorker;
+using sharp::MemoryBudget;
+using sharp::AdmitMemory;
+using sharp::RecordCost;
+using sharp::ReleaseMemory;
+using sharp::ShortestJobFirst;
 using sharp::counterQueue;
 
 enum class Canvas {
@@ -56,12 +118,17 @@ struct ResizeBaton {
   std::string fileIn;
   char *bufferIn;
   size_t bufferInLength;
+  bool bufferInCopy;
+  std::vector<std::pair<char*, size_t>> bufferInChunks;
   std::string iccProfilePath;
   int limitInputPixels;
   std::string output;
   std::string outputFormat;
   void *bufferOut;
   size_t bufferOutLength;
+  GBytes *bufferOutBytes;
+  int streamOutFd;
+  bool outputStreamed;
   int topOffsetPre;
   int leftOffsetPre;
   int widthPre;
@@ -74,6 +141,10 @@ struct ResizeBaton {
   int height;
   Canvas canvas;
   int gravity;
+  double cropCentreX;
+  double cropCentreY;
+  int cropOffsetLeft;
+  int cropOffsetTop;
   std::string interpolator;
   double background[4];
   bool flatten;
@@ -84,6 +155,8 @@ struct ResizeBaton {
   double gamma;
   bool greyscale;
   bool normalize;
+  double normalizeLower;
+  double normalizeUpper;
   int angle;
   bool rotateBeforePreExtract;
   bool flip;
@@ -102,16 +175,52 @@ struct ResizeBaton {
   bool withMetadata;
   int tileSize;
   int tileOverlap;
+  int tileLevel;
+  int tileColumn;
+  int tileRow;
+  bool tiffTile;
+  int tiffTileSize;
+  bool tiffPyramid;
+  std::string tiffCompression;
+  std::string tiffPredictor;
+  std::vector<ResizeBaton*> renditions;
+  Priority priority;
+  int timeout;
+  gint64 deadline;
+  volatile int cancelled;
+  bool timings;
+  gint64 queuedAt;
+  gint64 queueTime;
+  gint64 openTime;
+  gint64 reloadTime;
+  gint64 buildTime;
+  gint64 renderTime;
+  int inputWidth;
+  int inputHeight;
+  int shrinkOnLoad;
+  int xshrink;
+  int yshrink;
+  std::string errCode;
+  std::string outputKey;
+  bool headerOnWorker;
 
   ResizeBaton():
     bufferInLength(0),
+    bufferInCopy(false),
     limitInputPixels(0),
     outputFormat(""),
     bufferOutLength(0),
+    bufferOutBytes(NULL),
+    streamOutFd(-1),
+    outputStreamed(false),
     topOffsetPre(-1),
     topOffsetPost(-1),
     canvas(Canvas::CROP),
     gravity(0),
+    cropCentreX(0.5),
+    cropCentreY(0.5),
+    cropOffsetLeft(-1),
+    cropOffsetTop(-1),
     flatten(false),
     blurSigma(0.0),
     sharpenRadius(0),
@@ -120,6 +229,8 @@ struct ResizeBaton {
     gamma(0.0),
     greyscale(false),
     normalize(false),
+    normalizeLower(0.0),
+    normalizeUpper(100.0),
     angle(0),
     flip(false),
     flop(false),
@@ -134,7 +245,32 @@ struct ResizeBaton {
     optimiseScans(false),
     withMetadata(false),
     tileSize(256),
-    tileOverlap(0) {
+    tileOverlap(0),
+    tileLevel(-1),
+    tileColumn(-1),
+    tileRow(-1),
+    tiffTile(false),
+    tiffTileSize(256),
+    tiffPyramid(false),
+    tiffCompression("jpeg"),
+    tiffPredictor("none"),
+    priority(Priority::NORMAL),
+    timeout(0),
+    deadline(0),
+    cancelled(0),
+    timings(false),
+    queuedAt(0),
+    queueTime(0),
+    openTime(0),
+    reloadTime(0),
+    buildTime(0),
+    renderTime(0),
+    inputWidth(0),
+    inputHeight(0),
+    shrinkOnLoad(1),
+    xshrink(1),
+    yshrink(1),
+    headerOnWorker(false) {
       background[0] = 0.0;
       background[1] = 0.0;
       background[2] = 0.0;
@@ -143,7 +279,7 @@ struct ResizeBaton {
 };
 
 /*
-  Delete input char[] buffer and notify V8 of memory deallocation
+  Delete copied input char[] buffer
   Used as the callback function for the "postclose" signal
 */
 static void DeleteBuffer(VipsObject *object, char *buffer) {
@@ -152,11 +288,197 @@ static void DeleteBuffer(VipsObject *object, char *buffer) {
   }
 }
 
+/*
+  Free output data allocated by libvips via g_malloc
+  Used as the callback function when the Buffer wrapping it is garbage collected
+*/
+static void FreeBufferOut(char *data, void *hint) {
+  g_free(data);
+}
+
+/*
+  Release a reference to output data shared with the output cache
+  Used as the callback function when the Buffer wrapping it is garbage collected
+*/
+static void FreeBufferOutBytes(char *data, void *hint) {
+  g_bytes_unref(static_cast<GBytes*>(hint));
+}
+
+/*
+  Has the task been cancelled, or passed its deadline?
+*/
+static bool IsStopped(ResizeBaton *baton) {
+  return g_atomic_int_get(&baton->cancelled) || (baton->deadline > 0 && g_get_monotonic_time() > baton->deadline);
+}
+
+/*
+  Microseconds elapsed since a mark on the monotonic clock, moving the mark to now
+*/
+static gint64 Elapsed(gint64 &mark) {
+  gint64 now = g_get_monotonic_time();
+  gint64 elapsed = now - mark;
+  mark = now;
+  return elapsed;
+}
+
+/*
+  Load a resolution level of a multi-resolution input, being a TIFF page or an OpenSlide level
+*/
+static VipsImage* LoadLevel(ResizeBaton const *baton, ImageType const inputImageType, int const index) {
+  VipsImage *level = NULL;
+  if (inputImageType == ImageType::OPENSLIDE) {
+    if (vips_openslideload(baton->fileIn.c_str(), &level, "level", index, NULL)) {
+      return NULL;
+    }
+  } else if (baton->bufferInLength > 1) {
+    if (vips_tiffload_buffer(baton->bufferIn, baton->bufferInLength, &level, "page", index, NULL)) {
+      return NULL;
+    }
+  } else {
+    if (vips_tiffload(baton->fileIn.c_str(), &level, "page", index, NULL)) {
+      return NULL;
+    }
+  }
+  return level;
+}
+
+/*
+  TIFF compression and predictor from their names, defaulting to JPEG compression without a predictor
+*/
+static VipsForeignTiffCompression TiffCompressionFromName(std::string const &name) {
+  if (name == "none") {
+    return VIPS_FOREIGN_TIFF_COMPRESSION_NONE;
+  } else if (name == "deflate") {
+    return VIPS_FOREIGN_TIFF_COMPRESSION_DEFLATE;
+  } else if (name == "lzw") {
+    return VIPS_FOREIGN_TIFF_COMPRESSION_LZW;
+  }
+  return VIPS_FOREIGN_TIFF_COMPRESSION_JPEG;
+}
+
+static VipsForeignTiffPredictor TiffPredictorFromName(std::string const &name) {
+  if (name == "horizontal") {
+    return VIPS_FOREIGN_TIFF_PREDICTOR_HORIZONTAL;
+  } else if (name == "float") {
+    return VIPS_FOREIGN_TIFF_PREDICTOR_FLOAT;
+  }
+  return VIPS_FOREIGN_TIFF_PREDICTOR_NONE;
+}
+
+/*
+  Is this an 8-bit image with an embedded sRGB profile? If so, transforming it to sRGB would change neither its pixels nor depth.
+*/
+static bool IsSrgbUchar(VipsImage *image, std::string const &srgbProfile) {
+  return image->BandFmt == VIPS_FORMAT_UCHAR && HasSrgbProfile(image, srgbProfile);
+}
+
+/*
+  Identify the input of a task by a hash of its data or, for a file, its path, inode, size and modification time.
+  The modification time has nanosecond resolution where the platform provides it, else one second.
+  Returns an empty string when the input cannot be identified.
+*/
+static std::string InputKey(ResizeBaton const *baton) {
+  if (baton->bufferInLength > 1) {
+    char hash[17];
+    g_snprintf(hash, sizeof(hash), "%016" G_GINT64_MODIFIER "x",
+      static_cast<guint64>(HashData(baton->bufferIn, baton->bufferInLength)));
+    return "buffer:" + std::to_string(baton->bufferInLength) + ":" + hash;
+  }
+  GStatBuf st;
+  if (g_stat(baton->fileIn.c_str(), &st) != 0) {
+    return "";
+  }
+  std::string mtime = std::to_string(st.st_mtime);
+#if defined(__APPLE__)
+  mtime.append(".").append(std::to_string(st.st_mtimespec.tv_nsec));
+#elif !defined(_WIN32)
+  mtime.append(".").append(std::to_string(st.st_mtim.tv_nsec));
+#endif
+  return "file:" + std::to_string(st.st_ino) + ":" + std::to_string(st.st_size) + ":" + mtime + ":" + baton->fileIn;
+}
+
+/*
+  Dimensions of a processed output image, which are those of any extracted region
+*/
+static std::tuple<int, int> OutputDimensions(ResizeBaton const *output) {
+  int width = output->width;
+  int height = output->height;
+  if (output->topOffsetPre != -1 && (output->width == -1 || output->height == -1)) {
+    width = output->widthPre;
+    height = output->heightPre;
+  }
+  if (output->topOffsetPost != -1) {
+    width = output->widthPost;
+    height = output->heightPost;
+  }
+  return std::make_tuple(width, height);
+}
+
+/*
+  Append the canonical form of an option to a cache key
+*/
+static void AppendKey(std::string &key, double const value) {
+  char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+  key.append(g_ascii_dtostr(buffer, sizeof(buffer), value)).append(",");
+}
+
+static void AppendKey(std::string &key, std::string const &value) {
+  key.append(std::to_string(value.size())).append(":").append(value).append(",");
+}
+
+/*
+  Canonical form of the options that determine the output of a task, other than its input
+*/
+static std::string OptionsKey(ResizeBaton const *baton) {
+  std::string key = "|";
+  AppendKey(key, baton->iccProfilePath);
+  AppendKey(key, baton->limitInputPixels);
+  AppendKey(key, baton->output);
+  for (int value : { baton->topOffsetPre, baton->leftOffsetPre, baton->widthPre, baton->heightPre,
+    baton->topOffsetPost, baton->leftOffsetPost, baton->widthPost, baton->heightPost, baton->width, baton->height,
+    static_cast<int>(baton->canvas), baton->gravity, baton->sharpenRadius, baton->angle, baton->quality, baton->compressionLevel,
+    baton->tileSize, baton->tileOverlap, baton->tileLevel, baton->tileColumn, baton->tileRow, baton->tiffTileSize }) {
+    AppendKey(key, value);
+  }
+  AppendKey(key, baton->interpolator);
+  AppendKey(key, baton->tiffCompression);
+  AppendKey(key, baton->tiffPredictor);
+  for (double value : { baton->background[0], baton->background[1], baton->background[2], baton->background[3],
+    baton->blurSigma, baton->sharpenFlat, baton->sharpenJagged, baton->gamma, baton->normalizeLower, baton->normalizeUpper }) {
+    AppendKey(key, value);
+  }
+  for (bool value : { baton->flatten, baton->greyscale, baton->normalize, baton->rotateBeforePreExtract, baton->flip,
+    baton->flop, baton->progressive, baton->withoutEnlargement, baton->withoutAdaptiveFiltering,
+    baton->withoutChromaSubsampling, baton->trellisQuantisation, baton->overshootDeringing, baton->optimiseScans,
+    baton->withMetadata, baton->tiffTile, baton->tiffPyramid }) {
+    key.append(value ? "1" : "0");
+  }
+  return key;
+}
+
+/*
+  Kill evaluation of an image once its task has been cancelled or passed its deadline
+  Used as the callback function for the "eval" signal, emitted as each batch of tiles is computed
+*/
+static void StopEval(VipsImage *image, VipsProgress *progress, ResizeBaton *baton) {
+  if (IsStopped(baton)) {
+    vips_image_set_kill(image, TRUE);
+  }
+}
+
+// Estimate the peak memory of a task, as used for admission control, defined with QueueTask
+static size_t EstimateMemory(ResizeBaton const *baton, ImageHeader const &header);
+
+// Tasks that can be cancelled, by ID, accessed only on the JavaScript thread
+static std::map<int, ResizeBaton*> tasks;
+static int nextTaskId = 1;
+
 class ResizeWorker : public NanAsyncWorker {
 
  public:
-  ResizeWorker(NanCallback *callback, ResizeBaton *baton, NanCallback *queueListener) :
-    NanAsyncWorker(callback), baton(baton), queueListener(queueListener) {}
+  ResizeWorker(NanCallback *callback, ResizeBaton *baton, NanCallback *queueListener, bool sharedQueueListener, int taskId) :
+    NanAsyncWorker(callback), baton(baton), queueListener(queueListener), sharedQueueListener(sharedQueueListener),
+    taskId(taskId), admittedMemory(0), inputImageType(ImageType::UNKNOWN) {}
   ~ResizeWorker() {}
 
   /*
@@ -169,14 +491,84 @@ class ResizeWorker : public NanAsyncWorker {
     // Increment processing task counter
     g_atomic_int_inc(&counterProcess);
 
+    gint64 start = g_get_monotonic_time();
+    Process(start);
+    if (admittedMemory > 0) {
+      ReleaseMemory(admittedMemory);
+    }
+
+    // Record metrics of the input, whether processed or not
+    guint64 bytes = baton->bufferInLength;
+    if (bytes == 0 && !baton->fileIn.empty()) {
+      GStatBuf st;
+      if (g_stat(baton->fileIn.c_str(), &st) == 0) {
+        bytes = static_cast<guint64>(st.st_size);
+      }
+    }
+    RecordTask(inputImageType, baton->err.empty(), baton->queueTime, g_get_monotonic_time() - start, bytes,
+      static_cast<guint64>(baton->inputWidth) * static_cast<guint64>(baton->inputHeight), baton->shrinkOnLoad);
+  }
+
+  /*
+    Process the task, timing each stage from its wait in the queue
+  */
+  void Process(gint64 mark) {
+    baton->queueTime = mark - baton->queuedAt;
+
+    // Drop the task without running it if it was cancelled or timed out while queued
+    if (IsStopped(baton)) {
+      if (baton->bufferInCopy) {
+        delete[] baton->bufferIn;
+      }
+      CloseStreamOut();
+      return Stopped();
+    }
+
+    // Complete with the encoded output of an earlier task with the same input and options, without processing
+    if (
+      OutputCacheEnabled() && baton->renditions.empty() && baton->bufferInChunks.empty() &&
+      baton->output.compare(0, 2, "__") == 0 && !baton->timings
+    ) {
+      baton->outputKey = InputKey(baton);
+      if (!baton->outputKey.empty()) {
+        baton->outputKey.append(OptionsKey(baton));
+        CachedOutput cached;
+        if (GetOutput(baton->outputKey, cached)) {
+          return Cached(cached);
+        }
+      }
+    }
+
+    // Read the header of file input here rather than on the JavaScript thread, recording its cost for the
+    // ordering of later file input and waiting until its estimated memory fits within the memory budget
+    if (baton->headerOnWorker) {
+      ImageHeader header;
+      if (ParseHeader(baton->fileIn.c_str(), header)) {
+        RecordCost(static_cast<double>(header.width) * static_cast<double>(header.height));
+        if (MemoryBudget() > 0) {
+          admittedMemory = EstimateMemory(baton, header);
+          AdmitMemory(admittedMemory);
+          if (IsStopped(baton)) {
+            CloseStreamOut();
+            return Stopped();
+          }
+        }
+      }
+    }
+
     // Latest v2 sRGB ICC profile
     std::string srgbProfile = baton->iccProfilePath + "sRGB_IEC61966-2-1_black_scaled.icc";
 
     // Create "hook" VipsObject to hang image references from
     hook = reinterpret_cast<VipsObject*>(vips_image_new());
 
+    // Join chunks received from a Stream into a single buffer, deleted as per a copy
+    if (!baton->bufferInChunks.empty() && baton->bufferInLength > 1) {
+      baton->bufferIn = JoinChunks(baton->bufferInChunks, baton->bufferInLength);
+      baton->bufferInCopy = TRUE;
+    }
+
     // Input
-    ImageType inputImageType = ImageType::UNKNOWN;
     VipsImage *image = NULL;
     if (baton->bufferInLength > 1) {
       // From buffer
@@ -184,17 +576,23 @@ class ResizeWorker : public NanAsyncWorker {
       if (inputImageType != ImageType::UNKNOWN) {
         image = InitImage(baton->bufferIn, baton->bufferInLength, baton->accessMethod);
         if (image != NULL) {
-          // Listen for "postclose" signal to delete input buffer
-          g_signal_connect(image, "postclose", G_CALLBACK(DeleteBuffer), baton->bufferIn);
+          if (baton->bufferInCopy) {
+            // Listen for "postclose" signal to delete copy of input buffer
+            g_signal_connect(image, "postclose", G_CALLBACK(DeleteBuffer), baton->bufferIn);
+          }
         } else {
           // Could not read header data
           (baton->err).append("Input buffer has corrupt header");
           inputImageType = ImageType::UNKNOWN;
-          DeleteBuffer(NULL, baton->bufferIn);
+          if (baton->bufferInCopy) {
+            DeleteBuffer(NULL, baton->bufferIn);
+          }
         }
       } else {
         (baton->err).append("Input buffer contains unsupported image format");
-        DeleteBuffer(NULL, baton->bufferIn);
+        if (baton->bufferInCopy) {
+          DeleteBuffer(NULL, baton->bufferIn);
+        }
       }
     } else {
       // From file
@@ -213,6 +611,7 @@ class ResizeWorker : public NanAsyncWorker {
       return Error();
     }
     vips_object_local(hook, image);
+    baton->openTime = Elapsed(mark);
 
     // Limit input images to a given number of pixels, where pixels = width * height
     if (image->Xsize * image->Ysize > baton->limitInputPixels) {
@@ -229,6 +628,42 @@ class ResizeWorker : public NanAsyncWorker {
       baton->flip = TRUE;
     }
 
+    // Resolution levels of a multi-resolution input, which can stand in for shrink-on-load
+    std::vector<ImageLevel> levels;
+    if (inputImageType == ImageType::OPENSLIDE) {
+      levels = OpenSlideLevels(image);
+    } else if (inputImageType == ImageType::TIFF) {
+      levels = (baton->bufferInLength > 1)
+        ? ParseTiffLevels(baton->bufferIn, baton->bufferInLength)
+        : ParseTiffLevels(baton->fileIn.c_str());
+    }
+
+    // A Deep Zoom tile is located at full resolution but read from the smallest resolution level that covers its zoom level
+    int fullWidth = image->Xsize;
+    int fullHeight = image->Ysize;
+    int tileScale = 1;
+    if (baton->tileLevel != -1) {
+      int maxLevel = 0;
+      while ((1 << maxLevel) < std::max(fullWidth, fullHeight)) {
+        maxLevel++;
+      }
+      if (baton->tileLevel > maxLevel) {
+        (baton->err).append("Tile level " + std::to_string(baton->tileLevel) + " is beyond the maximum level " +
+          std::to_string(maxLevel));
+        return Error();
+      }
+      tileScale = 1 << (maxLevel - baton->tileLevel);
+      size_t level = ChooseLevel(levels, tileScale);
+      if (level > 0) {
+        VipsImage *reduced = LoadLevel(baton, inputImageType, levels[level].index);
+        if (reduced == NULL) {
+          return Error();
+        }
+        vips_object_local(hook, reduced);
+        image = reduced;
+      }
+    }
+
     // Rotate pre-extract
     if (baton->rotateBeforePreExtract && rotation != Angle::D0) {
       VipsImage *rotated;
@@ -239,6 +674,34 @@ class ResizeWorker : public NanAsyncWorker {
       image = rotated;
     }
 
+    // A single Deep Zoom tile is a pre-resize extraction of only the input pixels under it, resized to the tile dimensions
+    if (baton->tileLevel != -1) {
+      if (baton->rotateBeforePreExtract && (rotation == Angle::D90 || rotation == Angle::D270)) {
+        std::swap(fullWidth, fullHeight);
+      }
+      int left;
+      int top;
+      int width;
+      int height;
+      std::tie(left, width, baton->width) =
+        CalculateTileSpan(fullWidth, tileScale, baton->tileSize, baton->tileOverlap, baton->tileColumn);
+      std::tie(top, height, baton->height) =
+        CalculateTileSpan(fullHeight, tileScale, baton->tileSize, baton->tileOverlap, baton->tileRow);
+      if (baton->width == 0 || baton->height == 0) {
+        (baton->err).append("Tile " + std::to_string(baton->tileColumn) + "," + std::to_string(baton->tileRow) +
+          " is outside level " + std::to_string(baton->tileLevel));
+        return Error();
+      }
+      // Scale the region from full resolution to the resolution level loaded
+      double xlevel = static_cast<double>(image->Xsize) / static_cast<double>(fullWidth);
+      double ylevel = static_cast<double>(image->Ysize) / static_cast<double>(fullHeight);
+      baton->leftOffsetPre = std::min(static_cast<int>(floor(left * xlevel)), image->Xsize - 1);
+      baton->topOffsetPre = std::min(static_cast<int>(floor(top * ylevel)), image->Ysize - 1);
+      baton->widthPre = std::max(1, std::min(static_cast<int>(ceil((left + width) * xlevel)), image->Xsize) - baton->leftOffsetPre);
+      baton->heightPre = std::max(1, std::min(static_cast<int>(ceil((top + height) * ylevel)), image->Ysize) - baton->topOffsetPre);
+      baton->canvas = Canvas::IGNORE_ASPECT;
+    }
+
     // Pre extraction
     if (baton->topOffsetPre != -1) {
       VipsImage *extractedPre;
@@ -258,6 +721,8 @@ class ResizeWorker : public NanAsyncWorker {
       inputWidth = inputHeight;
       inputHeight = swap;
     }
+    baton->inputWidth = inputWidth;
+    baton->inputHeight = inputHeight;
 
     // Get window size of interpolator, used for determining shrink vs affine
     int interpolatorWindowSize = InterpolatorWindowSize(baton->interpolator.c_str());
@@ -265,134 +730,160 @@ class ResizeWorker : public NanAsyncWorker {
       return Error();
     }
 
-    // Scaling calculations
-    double xfactor = 1.0;
-    double yfactor = 1.0;
-    if (baton->width > 0 && baton->height > 0) {
-      // Fixed width and height
-      xfactor = static_cast<double>(inputWidth) / static_cast<double>(baton->width);
-      yfactor = static_cast<double>(inputHeight) / static_cast<double>(baton->height);
-      switch (baton->canvas) {
-        case Canvas::CROP:
-          xfactor = std::min(xfactor, yfactor);
-          yfactor = xfactor;
-          break;
-        case Canvas::EMBED:
-          xfactor = std::max(xfactor, yfactor);
-          yfactor = xfactor;
-          break;
-        case Canvas::MAX:
-          if (xfactor > yfactor) {
-            baton->height = static_cast<int>(round(static_cast<double>(inputHeight) / xfactor));
-            yfactor = xfactor;
-          } else {
-            baton->width = static_cast<int>(round(static_cast<double>(inputWidth) / yfactor));
-            xfactor = yfactor;
-          }
-          break;
-        case Canvas::MIN:
-          if (xfactor < yfactor) {
-            baton->height = static_cast<int>(round(static_cast<double>(inputHeight) / xfactor));
-            yfactor = xfactor;
-          } else {
-            baton->width = static_cast<int>(round(static_cast<double>(inputWidth) / yfactor));
-            xfactor = yfactor;
-          }
-          break;
-        case Canvas::IGNORE_ASPECT:
-          // xfactor, yfactor OK!
-          break;
+    // Each output is either the baton itself or, when fanning out, one of its renditions
+    std::vector<ResizeBaton*> outputs;
+    if (baton->renditions.empty()) {
+      outputs.push_back(baton);
+    } else {
+      outputs = baton->renditions;
+    }
+
+    // Scaling calculations for each output, relative to the pre-resize image
+    std::vector<double> xfactors;
+    std::vector<double> yfactors;
+    std::vector<bool> resample;
+    int shrink_on_load = INT_MAX;
+    for (ResizeBaton *output : outputs) {
+      if (flip && !output->flip) {
+        // Add flip operation due to EXIF mirroring
+        output->flip = TRUE;
       }
-    } else if (baton->width > 0) {
-      // Fixed width
-      xfactor = static_cast<double>(inputWidth) / static_cast<double>(baton->width);
-      if (baton->canvas == Canvas::IGNORE_ASPECT) {
-        baton->height = inputHeight;
-      } else {
-        // Auto height
-        yfactor = xfactor;
-        baton->height = static_cast<int>(floor(static_cast<double>(inputHeight) / yfactor));
+      double xfactor;
+      double yfactor;
+      std::tie(xfactor, yfactor) = CalculateFactors(output, inputWidth, inputHeight);
+
+      // Calculate integral box shrink
+      int xshrink = CalculateShrink(xfactor, interpolatorWindowSize);
+      int yshrink = CalculateShrink(yfactor, interpolatorWindowSize);
+
+      // Do not enlarge the output if the input width *or* height are already less than the required dimensions
+      bool resampled = TRUE;
+      if (output->withoutEnlargement) {
+        if (inputWidth < output->width || inputHeight < output->height) {
+          xfactor = 1;
+          yfactor = 1;
+          xshrink = 1;
+          yshrink = 1;
+          resampled = FALSE;
+          output->width = inputWidth;
+          output->height = inputHeight;
+        }
       }
-    } else if (baton->height > 0) {
-      // Fixed height
-      yfactor = static_cast<double>(inputHeight) / static_cast<double>(baton->height);
-      if (baton->canvas == Canvas::IGNORE_ASPECT) {
-        baton->width = inputWidth;
+
+      // If integral x and y shrink are equal, try to use libjpeg (by 2, 4 or 8) or libwebp (by any integer) shrink-on-load,
+      // but not when applying gamma correction or pre-resize extract.
+      // With many outputs, the largest of them limits the shrink-on-load factor shared by all.
+      if (xshrink == yshrink && inputImageType == ImageType::JPEG && xshrink >= 2 && baton->gamma == 0 && baton->topOffsetPre == -1) {
+        if (xshrink >= 8) {
+          shrink_on_load = std::min(shrink_on_load, 8);
+        } else if (xshrink >= 4) {
+          shrink_on_load = std::min(shrink_on_load, 4);
+        } else {
+          shrink_on_load = std::min(shrink_on_load, 2);
+        }
+#if (VIPS_MAJOR_VERSION >= 8)
+      } else if (
+        xshrink == yshrink && inputImageType == ImageType::WEBP && xshrink >= 2 && baton->gamma == 0 && baton->topOffsetPre == -1
+      ) {
+        shrink_on_load = std::min(shrink_on_load, xshrink);
+#endif
+      } else if (
+        levels.size() > 1 && std::min(xshrink, yshrink) >= 2 && baton->gamma == 0 && baton->topOffsetPre == -1
+      ) {
+        // A multi-resolution input can load any resolution level, so is limited by the smaller of the two shrinks
+        shrink_on_load = std::min(shrink_on_load, std::min(xshrink, yshrink));
       } else {
-        // Auto width
-        xfactor = yfactor;
-        baton->width = static_cast<int>(floor(static_cast<double>(inputWidth) / xfactor));
+        shrink_on_load = 1;
       }
-    } else {
-      // Identity transform
-      baton->width = inputWidth;
-      baton->height = inputHeight;
+      xfactors.push_back(xfactor);
+      yfactors.push_back(yfactor);
+      resample.push_back(resampled);
     }
-
-    // Calculate integral box shrink
-    int xshrink = CalculateShrink(xfactor, interpolatorWindowSize);
-    int yshrink = CalculateShrink(yfactor, interpolatorWindowSize);
-
-    // Calculate residual float affine transformation
-    double xresidual = CalculateResidual(xshrink, xfactor);
-    double yresidual = CalculateResidual(yshrink, yfactor);
-
-    // Do not enlarge the output if the input width *or* height are already less than the required dimensions
-    if (baton->withoutEnlargement) {
-      if (inputWidth < baton->width || inputHeight < baton->height) {
-        xfactor = 1;
-        yfactor = 1;
-        xshrink = 1;
-        yshrink = 1;
-        xresidual = 0;
-        yresidual = 0;
-        baton->width = inputWidth;
-        baton->height = inputHeight;
+    // A multi-resolution input whose levels are all larger than the shrink allows keeps the full resolution level
+    size_t loadLevel = 0;
+    if (levels.size() > 1 && shrink_on_load > 1) {
+      loadLevel = ChooseLevel(levels, shrink_on_load);
+      if (loadLevel == 0) {
+        shrink_on_load = 1;
       }
     }
-
-    // If integral x and y shrink are equal, try to use libjpeg shrink-on-load, but not when applying gamma correction or pre-resize extract
-    int shrink_on_load = 1;
-    if (xshrink == yshrink && inputImageType == ImageType::JPEG && xshrink >= 2 && baton->gamma == 0 && baton->topOffsetPre == -1) {
-      if (xshrink >= 8) {
-        xfactor = xfactor / 8;
-        yfactor = yfactor / 8;
-        shrink_on_load = 8;
-      } else if (xshrink >= 4) {
-        xfactor = xfactor / 4;
-        yfactor = yfactor / 4;
-        shrink_on_load = 4;
-      } else if (xshrink >= 2) {
-        xfactor = xfactor / 2;
-        yfactor = yfactor / 2;
-        shrink_on_load = 2;
+    // Start from a cached intermediate of the same input, decoded with the same or a smaller shrink-on-load factor
+    // and already colour-managed, when available. Pre-resize extraction changes the intermediate, so is not cached.
+    std::string intermediateKey;
+    VipsImage *cached = NULL;
+    if (IntermediatesEnabled() && baton->topOffsetPre == -1) {
+      intermediateKey = InputKey(baton);
+      if (!intermediateKey.empty()) {
+        int level;
+        cached = GetIntermediate(intermediateKey, shrink_on_load, level);
+        if (cached != NULL) {
+          vips_object_local(hook, cached);
+          VipsImage *owned;
+          if (Own(cached, &owned)) {
+            return Error();
+          }
+          vips_object_local(hook, owned);
+          image = owned;
+          shrink_on_load = level;
+        }
       }
     }
-    if (shrink_on_load > 1) {
-      // Recalculate integral shrink and double residual
-      xfactor = std::max(xfactor, 1.0);
-      yfactor = std::max(yfactor, 1.0);
-      xshrink = CalculateShrink(xfactor, interpolatorWindowSize);
-      yshrink = CalculateShrink(yfactor, interpolatorWindowSize);
-      xresidual = CalculateResidual(xshrink, xfactor);
-      yresidual = CalculateResidual(yshrink, yfactor);
+    // Ratio of pre-resize to shrunk-on-load dimensions, used to adjust the scaling factors
+    double xloadFactor = 1.0;
+    double yloadFactor = 1.0;
+    if (shrink_on_load > 1 && cached == NULL) {
       // Reload input using shrink-on-load
       VipsImage *shrunkOnLoad;
-      if (baton->bufferInLength > 1) {
-        if (vips_jpegload_buffer(baton->bufferIn, baton->bufferInLength, &shrunkOnLoad, "shrink", shrink_on_load, NULL)) {
+      if (loadLevel > 0) {
+        // Load the chosen resolution level of a multi-resolution input
+        shrunkOnLoad = LoadLevel(baton, inputImageType, levels[loadLevel].index);
+        if (shrunkOnLoad == NULL) {
           return Error();
         }
+      } else if (inputImageType == ImageType::JPEG) {
+        if (baton->bufferInLength > 1) {
+          if (vips_jpegload_buffer(baton->bufferIn, baton->bufferInLength, &shrunkOnLoad, "shrink", shrink_on_load, NULL)) {
+            return Error();
+          }
+        } else {
+          if (vips_jpegload((baton->fileIn).c_str(), &shrunkOnLoad, "shrink", shrink_on_load, NULL)) {
+            return Error();
+          }
+        }
+#if (VIPS_MAJOR_VERSION >= 8)
       } else {
-        if (vips_jpegload((baton->fileIn).c_str(), &shrunkOnLoad, "shrink", shrink_on_load, NULL)) {
-          return Error();
+        if (baton->bufferInLength > 1) {
+          if (vips_webpload_buffer(baton->bufferIn, baton->bufferInLength, &shrunkOnLoad, "shrink", shrink_on_load, NULL)) {
+            return Error();
+          }
+        } else {
+          if (vips_webpload((baton->fileIn).c_str(), &shrunkOnLoad, "shrink", shrink_on_load, NULL)) {
+            return Error();
+          }
         }
+#endif
       }
       vips_object_local(hook, shrunkOnLoad);
       image = shrunkOnLoad;
     }
+    if (shrink_on_load > 1) {
+      // libjpeg rounds shrunk dimensions up, libwebp rounds them down and resolution levels need not be exact,
+      // so measure rather than assume
+      int loadWidth = image->Xsize;
+      int loadHeight = image->Ysize;
+      if (rotation == Angle::D90 || rotation == Angle::D270) {
+        // Swap input output width and height when rotating by 90 or 270 degrees
+        std::swap(loadWidth, loadHeight);
+      }
+      xloadFactor = static_cast<double>(inputWidth) / static_cast<double>(loadWidth);
+      yloadFactor = static_cast<double>(inputHeight) / static_cast<double>(loadHeight);
+      baton->shrinkOnLoad = shrink_on_load;
+    }
+    baton->reloadTime = Elapsed(mark);
 
-    // Ensure we're using a device-independent colour space
-    if (HasProfile(image)) {
+    // Ensure we're using a device-independent colour space, which a cached intermediate already is
+    // An embedded sRGB profile makes the transform an identity, so skip it for 8-bit images
+    if (cached == NULL && HasProfile(image) && !IsSrgbUchar(image, srgbProfile)) {
       // Convert to sRGB using embedded profile
       VipsImage *transformed;
       if (!vips_icc_transform(image, &transformed, srgbProfile.c_str(), "embedded", TRUE, NULL)) {
@@ -400,7 +891,7 @@ class ResizeWorker : public NanAsyncWorker {
         vips_object_local(hook, transformed);
         image = transformed;
       }
-    } else if (image->Type == VIPS_INTERPRETATION_CMYK) {
+    } else if (cached == NULL && image->Type == VIPS_INTERPRETATION_CMYK) {
       // Convert to sRGB using default "USWebCoatedSWOP" CMYK profile
       std::string cmykProfile = baton->iccProfilePath + "USWebCoatedSWOP.icc";
       VipsImage *transformed;
@@ -411,6 +902,23 @@ class ResizeWorker : public NanAsyncWorker {
       image = transformed;
     }
 
+    // Render the colour-managed intermediate into memory, to cache for later tasks with the same input,
+    // unless it is too large for the cache, in which case it remains lazy
+    if (!intermediateKey.empty() && cached == NULL && IntermediateFits(image)) {
+      VipsImage *memory;
+      if (Materialise(image, &memory)) {
+        return Error();
+      }
+      vips_object_local(hook, memory);
+      PutIntermediate(intermediateKey, shrink_on_load > 1 ? shrink_on_load : 1, memory);
+      VipsImage *owned;
+      if (Own(memory, &owned)) {
+        return Error();
+      }
+      vips_object_local(hook, owned);
+      image = owned;
+    }
+
     // Flatten image to remove alpha channel
     if (baton->flatten && HasAlpha(image)) {
       // Background colour
@@ -450,513 +958,743 @@ class ResizeWorker : public NanAsyncWorker {
       image = greyscale;
     }
 
-    if (xshrink > 1 || yshrink > 1) {
-      VipsImage *shrunk;
-      // Use vips_shrink with the integral reduction
-      if (vips_shrink(image, &shrunk, xshrink, yshrink, NULL)) {
+    // Render shared pre-resize image once when there are many outputs to generate from it
+    if (outputs.size() > 1) {
+      VipsImage *memory;
+      if (Materialise(image, &memory)) {
         return Error();
       }
-      vips_object_local(hook, shrunk);
-      image = shrunk;
-      // Recalculate residual float based on dimensions of required vs shrunk images
-      int shrunkWidth = shrunk->Xsize;
-      int shrunkHeight = shrunk->Ysize;
-      if (rotation == Angle::D90 || rotation == Angle::D270) {
-        // Swap input output width and height when rotating by 90 or 270 degrees
-        int swap = shrunkWidth;
-        shrunkWidth = shrunkHeight;
-        shrunkHeight = swap;
-      }
-      xresidual = static_cast<double>(baton->width) / static_cast<double>(shrunkWidth);
-      yresidual = static_cast<double>(baton->height) / static_cast<double>(shrunkHeight);
-      if (baton->canvas == Canvas::EMBED) {
-        xresidual = std::min(xresidual, yresidual);
-        yresidual = xresidual;
-      } else if (baton->canvas != Canvas::IGNORE_ASPECT) {
-        xresidual = std::max(xresidual, yresidual);
-        yresidual = xresidual;
-      }
+      vips_object_local(hook, memory);
+      image = memory;
     }
+    VipsImage *shared = image;
 
-    // Use vips_affine with the remaining float part
-    if (xresidual != 0.0 || yresidual != 0.0) {
-      // Use average of x and y residuals to compute sigma for Gaussian blur
-      double residual = (xresidual + yresidual) / 2.0;
-      // Apply Gaussian blur before large affine reductions
-      if (residual < 1.0) {
-        // Calculate standard deviation
-        double sigma = ((1.0 / residual) - 0.4) / 3.0;
-        if (sigma >= 0.3) {
-          // Create Gaussian function for standard deviation
-          VipsImage *gaussian;
-          if (vips_gaussmat(&gaussian, sigma, 0.2, "separable", TRUE, "integer", TRUE, NULL)) {
-            return Error();
-          }
-          vips_object_local(hook, gaussian);
-          // Sequential input requires a small linecache before use of convolution
-          if (baton->accessMethod == VIPS_ACCESS_SEQUENTIAL) {
-            VipsImage *lineCached;
-            if (vips_linecache(image, &lineCached, "access", VIPS_ACCESS_SEQUENTIAL, "tile_height", 1, "threaded", TRUE, NULL)) {
-              return Error();
-            }
-            vips_object_local(hook, lineCached);
-            image = lineCached;
-          }
-          // Apply Gaussian function
-          VipsImage *blurred;
-          if (vips_convsep(image, &blurred, gaussian, "precision", VIPS_PRECISION_INTEGER, NULL)) {
-            return Error();
-          }
-          vips_object_local(hook, blurred);
-          image = blurred;
-        }
-      }
-      // Create interpolator - "bilinear" (default), "bicubic" or "nohalo"
-      VipsInterpolate *interpolator = vips_interpolate_new(baton->interpolator.c_str());
-      if (interpolator == NULL) {
-        return Error();
-      }
-      vips_object_local(hook, interpolator);
-      // Perform affine transformation
-      VipsImage *affined;
-      if (vips_affine(image, &affined, xresidual, 0.0, 0.0, yresidual, "interpolate", interpolator, NULL)) {
-        return Error();
-      }
-      vips_object_local(hook, affined);
-      image = affined;
+    // Process outputs from largest to smallest, so each can cascade from the nearest larger intermediate
+    std::vector<size_t> order;
+    for (size_t i = 0; i < outputs.size(); i++) {
+      order.push_back(i);
     }
-
-    // Rotate
-    if (!baton->rotateBeforePreExtract && rotation != Angle::D0) {
-      VipsImage *rotated;
-      if (vips_rot(image, &rotated, static_cast<VipsAngle>(rotation), NULL)) {
-        return Error();
+    std::stable_sort(order.begin(), order.end(), [&xfactors, &yfactors](size_t a, size_t b) {
+      return xfactors[a] * yfactors[a] < xfactors[b] * yfactors[b];
+    });
+    VipsImage *intermediate = NULL;
+    for (size_t n = 0; n < order.size(); n++) {
+      ResizeBaton *output = outputs[order[n]];
+      image = shared;
+
+      // Scaling factors relative to the shared pre-resize image
+      double xfactor = xfactors[order[n]];
+      double yfactor = yfactors[order[n]];
+      if (shrink_on_load > 1) {
+        xfactor = std::max(xfactor / xloadFactor, 1.0);
+        yfactor = std::max(yfactor / yloadFactor, 1.0);
       }
-      vips_object_local(hook, rotated);
-      image = rotated;
-    }
 
-    // Flip (mirror about Y axis)
-    if (baton->flip) {
-      VipsImage *flipped;
-      if (vips_flip(image, &flipped, VIPS_DIRECTION_VERTICAL, NULL)) {
-        return Error();
+      // Cascade from the previous, larger intermediate when it still holds enough pixels for this output
+      if (intermediate != NULL) {
+        double xratio = static_cast<double>(intermediate->Xsize) / static_cast<double>(shared->Xsize);
+        double yratio = static_cast<double>(intermediate->Ysize) / static_cast<double>(shared->Ysize);
+        if (rotation == Angle::D90 || rotation == Angle::D270) {
+          std::swap(xratio, yratio);
+        }
+        if (xfactor * xratio >= 1.0 && yfactor * yratio >= 1.0) {
+          image = intermediate;
+          xfactor = xfactor * xratio;
+          yfactor = yfactor * yratio;
+        }
       }
-      vips_object_local(hook, flipped);
-      image = flipped;
-    }
 
-    // Flop (mirror about X axis)
-    if (baton->flop) {
-      VipsImage *flopped;
-      if (vips_flip(image, &flopped, VIPS_DIRECTION_HORIZONTAL, NULL)) {
-        return Error();
+      // Calculate integral box shrink and residual float affine transformation
+      int xshrink = CalculateShrink(xfactor, interpolatorWindowSize);
+      int yshrink = CalculateShrink(yfactor, interpolatorWindowSize);
+      double xresidual = 0.0;
+      double yresidual = 0.0;
+      if (resample[order[n]]) {
+        xresidual = CalculateResidual(xshrink, xfactor);
+        yresidual = CalculateResidual(yshrink, yfactor);
       }
-      vips_object_local(hook, flopped);
-      image = flopped;
-    }
-
-    // Crop/embed
-    if (image->Xsize != baton->width || image->Ysize != baton->height) {
-      if (baton->canvas == Canvas::EMBED) {
-        // Match background colour space, namely sRGB
-        if (image->Type != VIPS_INTERPRETATION_sRGB) {
-          // Convert to sRGB colour space
-          VipsImage *colourspaced;
-          if (vips_colourspace(image, &colourspaced, VIPS_INTERPRETATION_sRGB, NULL)) {
-            return Error();
-          }
-          vips_object_local(hook, colourspaced);
-          image = colourspaced;
+      output->xshrink = xshrink;
+      output->yshrink = yshrink;
+      if (xshrink > 1 || yshrink > 1) {
+        VipsImage *shrunk;
+        // Use vips_shrink with the integral reduction
+        if (vips_shrink(image, &shrunk, xshrink, yshrink, NULL)) {
+          return Error();
         }
-        // Add non-transparent alpha channel, if required
-        if (baton->background[3] < 255.0 && !HasAlpha(image)) {
-          // Create single-channel transparency
-          VipsImage *black;
-          if (vips_black(&black, image->Xsize, image->Ysize, "bands", 1, NULL)) {
-            return Error();
-          }
-          vips_object_local(hook, black);
-          // Invert to become non-transparent
-          VipsImage *alpha;
-          if (vips_invert(black, &alpha, NULL)) {
+        vips_object_local(hook, shrunk);
+        image = shrunk;
+        // Recalculate residual float based on dimensions of required vs shrunk images
+        int shrunkWidth = shrunk->Xsize;
+        int shrunkHeight = shrunk->Ysize;
+        if (rotation == Angle::D90 || rotation == Angle::D270) {
+          // Swap input output width and height when rotating by 90 or 270 degrees
+          int swap = shrunkWidth;
+          shrunkWidth = shrunkHeight;
+          shrunkHeight = swap;
+        }
+        xresidual = static_cast<double>(output->width) / static_cast<double>(shrunkWidth);
+        yresidual = static_cast<double>(output->height) / static_cast<double>(shrunkHeight);
+        if (output->canvas == Canvas::EMBED) {
+          xresidual = std::min(xresidual, yresidual);
+          yresidual = xresidual;
+        } else if (output->canvas != Canvas::IGNORE_ASPECT) {
+          xresidual = std::max(xresidual, yresidual);
+          yresidual = xresidual;
+        }
+      }
+
+      // Choose where to crop by scoring the content of the smaller, pre-affine image
+      if (output->canvas == Canvas::CROP && IsCropStrategy(output->gravity) && CanScoreCrop(image)) {
+        double scale = (xresidual != 0.0) ? xresidual : 1.0;
+        bool rotated = !baton->rotateBeforePreExtract && (rotation == Angle::D90 || rotation == Angle::D270);
+        // Crop window in pre-affine, pre-rotation pixels
+        int windowWidth = static_cast<int>(round((rotated ? output->height : output->width) / scale));
+        int windowHeight = static_cast<int>(round((rotated ? output->width : output->height) / scale));
+        if (windowWidth < image->Xsize || windowHeight < image->Ysize) {
+          // Render into memory so the pixels scored are not computed again for output
+          VipsImage *memory;
+          if (Materialise(image, &memory)) {
             return Error();
           }
-          vips_object_local(hook, alpha);
-          // Append alpha channel to existing image
-          VipsImage *joined;
-          if (vips_bandjoin2(image, alpha, &joined, NULL)) {
-            return Error();
+          vips_object_local(hook, memory);
+          image = memory;
+          double x;
+          double y;
+          std::tie(x, y) = ChooseCrop(image, windowWidth, windowHeight, output->gravity);
+          // Map the centre through the rotation and flips that follow
+          if (!baton->rotateBeforePreExtract) {
+            if (rotation == Angle::D90) {
+              std::tie(x, y) = std::make_tuple(1.0 - y, x);
+            } else if (rotation == Angle::D180) {
+              std::tie(x, y) = std::make_tuple(1.0 - x, 1.0 - y);
+            } else if (rotation == Angle::D270) {
+              std::tie(x, y) = std::make_tuple(y, 1.0 - x);
+            }
           }
-          vips_object_local(hook, joined);
-          image = joined;
+          output->cropCentreX = output->flop ? 1.0 - x : x;
+          output->cropCentreY = output->flip ? 1.0 - y : y;
         }
-        // Create background
-        VipsArrayDouble *background;
-        if (baton->background[3] < 255.0 || HasAlpha(image)) {
-          background = vips_array_double_newv(
-            4, baton->background[0], baton->background[1], baton->background[2], baton->background[3]
-          );
-        } else {
-          background = vips_array_double_newv(
-            3, baton->background[0], baton->background[1], baton->background[2]
-          );
+      }
+
+      // Use vips_affine with the remaining float part
+      if (xresidual != 0.0 || yresidual != 0.0) {
+        // Use average of x and y residuals to compute sigma for Gaussian blur
+        double residual = (xresidual + yresidual) / 2.0;
+        // Apply Gaussian blur before large affine reductions
+        if (residual < 1.0) {
+          // Calculate standard deviation
+          double sigma = ((1.0 / residual) - 0.4) / 3.0;
+          if (sigma >= 0.3) {
+            // Create Gaussian function for standard deviation
+            VipsImage *gaussian = GetGaussian(sigma, 0.2);
+            if (gaussian == NULL) {
+              return Error();
+            }
+            vips_object_local(hook, gaussian);
+            // Sequential input requires a small linecache before use of convolution
+            if (baton->accessMethod == VIPS_ACCESS_SEQUENTIAL) {
+              VipsImage *lineCached;
+              if (vips_linecache(image, &lineCached, "access", VIPS_ACCESS_SEQUENTIAL, "tile_height", 1, "threaded", TRUE, NULL)) {
+                return Error();
+              }
+              vips_object_local(hook, lineCached);
+              image = lineCached;
+            }
+            // Apply Gaussian function
+            VipsImage *blurred;
+            if (ConvolveSeparable(image, &blurred, gaussian)) {
+              return Error();
+            }
+            vips_object_local(hook, blurred);
+            image = blurred;
+          }
         }
-        // Embed
-        int left = (baton->width - image->Xsize) / 2;
-        int top = (baton->height - image->Ysize) / 2;
-        VipsImage *embedded;
-        if (vips_embed(image, &embedded, left, top, baton->width, baton->height,
-          "extend", VIPS_EXTEND_BACKGROUND, "background", background, NULL
-        )) {
-          vips_area_unref(reinterpret_cast<VipsArea*>(background));
+        // Create interpolator - "bilinear" (default), "bicubic" or "nohalo"
+        VipsInterpolate *interpolator = GetInterpolator(baton->interpolator);
+        if (interpolator == NULL) {
           return Error();
         }
-        vips_area_unref(reinterpret_cast<VipsArea*>(background));
-        vips_object_local(hook, embedded);
-        image = embedded;
-      } else if (baton->canvas != Canvas::IGNORE_ASPECT) {
-        // Crop/max/min
-        int left;
-        int top;
-        std::tie(left, top) = CalculateCrop(image->Xsize, image->Ysize, baton->width, baton->height, baton->gravity);
-        int width = std::min(image->Xsize, baton->width);
-        int height = std::min(image->Ysize, baton->height);
-        VipsImage *extracted;
-        if (vips_extract_area(image, &extracted, left, top, width, height, NULL)) {
+        vips_object_local(hook, interpolator);
+        // Perform affine transformation
+        VipsImage *affined;
+        if (vips_affine(image, &affined, xresidual, 0.0, 0.0, yresidual, "interpolate", interpolator, NULL)) {
           return Error();
         }
-        vips_object_local(hook, extracted);
-        image = extracted;
+        vips_object_local(hook, affined);
+        image = affined;
       }
-    }
 
-    // Post extraction
-    if (baton->topOffsetPost != -1) {
-      VipsImage *extractedPost;
-      if (vips_extract_area(image, &extractedPost,
-        baton->leftOffsetPost, baton->topOffsetPost, baton->widthPost, baton->heightPost, NULL
-      )) {
-        return Error();
+      // Keep an intermediate for the next, smaller output to cascade from
+      if (n + 1 < order.size()) {
+        if (Materialise(image, &intermediate)) {
+          return Error();
+        }
+        vips_object_local(hook, intermediate);
+        image = intermediate;
       }
-      vips_object_local(hook, extractedPost);
-      image = extractedPost;
-    }
 
-    // Blur
-    if (baton->blurSigma != 0.0) {
-      VipsImage *blurred;
-      if (baton->blurSigma < 0.0) {
-        // Fast, mild blur - averages neighbouring pixels
-        VipsImage *blur = vips_image_new_matrixv(3, 3,
-          1.0, 1.0, 1.0,
-          1.0, 1.0, 1.0,
-          1.0, 1.0, 1.0);
-        vips_image_set_double(blur, "scale", 9);
-        vips_object_local(hook, blur);
-        if (vips_conv(image, &blurred, blur, NULL)) {
-          return Error();
-        }
-      } else {
-        // Slower, accurate Gaussian blur
-        // Create Gaussian function for standard deviation
-        VipsImage *gaussian;
-        if (vips_gaussmat(&gaussian, baton->blurSigma, 0.2, "separable", TRUE, "integer", TRUE, NULL)) {
-          return Error();
-        }
-        vips_object_local(hook, gaussian);
-        // Apply Gaussian function
-        if (vips_convsep(image, &blurred, gaussian, "precision", VIPS_PRECISION_INTEGER, NULL)) {
+      // Rotate
+      if (!baton->rotateBeforePreExtract && rotation != Angle::D0) {
+        VipsImage *rotated;
+        if (vips_rot(image, &rotated, static_cast<VipsAngle>(rotation), NULL)) {
           return Error();
         }
+        vips_object_local(hook, rotated);
+        image = rotated;
       }
-      vips_object_local(hook, blurred);
-      image = blurred;
-    }
 
-    // Sharpen
-    if (baton->sharpenRadius != 0) {
-      VipsImage *sharpened;
-      if (baton->sharpenRadius == -1) {
-        // Fast, mild sharpen
-        VipsImage *sharpen = vips_image_new_matrixv(3, 3,
-          -1.0, -1.0, -1.0,
-          -1.0, 32.0, -1.0,
-          -1.0, -1.0, -1.0);
-        vips_image_set_double(sharpen, "scale", 24);
-        vips_object_local(hook, sharpen);
-        if (vips_conv(image, &sharpened, sharpen, NULL)) {
+      // Flip (mirror about Y axis)
+      if (output->flip) {
+        VipsImage *flipped;
+        if (vips_flip(image, &flipped, VIPS_DIRECTION_VERTICAL, NULL)) {
           return Error();
         }
-      } else {
-        // Slow, accurate sharpen in LAB colour space, with control over flat vs jagged areas
-        if (vips_sharpen(image, &sharpened, "radius", baton->sharpenRadius, "m1", baton->sharpenFlat, "m2", baton->sharpenJagged, NULL)) {
+        vips_object_local(hook, flipped);
+        image = flipped;
+      }
+
+      // Flop (mirror about X axis)
+      if (output->flop) {
+        VipsImage *flopped;
+        if (vips_flip(image, &flopped, VIPS_DIRECTION_HORIZONTAL, NULL)) {
           return Error();
         }
+        vips_object_local(hook, flopped);
+        image = flopped;
       }
-      vips_object_local(hook, sharpened);
-      image = sharpened;
-    }
 
-    // Gamma decoding (brighten)
-    if (baton->gamma >= 1 && baton->gamma <= 3) {
-      VipsImage *gammaDecoded;
-      if (vips_gamma(image, &gammaDecoded, "exponent", baton->gamma, NULL)) {
-        return Error();
+      // Crop/embed
+      if (image->Xsize != output->width || image->Ysize != output->height) {
+        if (output->canvas == Canvas::EMBED) {
+          // Match background colour space, namely sRGB
+          if (image->Type != VIPS_INTERPRETATION_sRGB) {
+            // Convert to sRGB colour space
+            VipsImage *colourspaced;
+            if (vips_colourspace(image, &colourspaced, VIPS_INTERPRETATION_sRGB, NULL)) {
+              return Error();
+            }
+            vips_object_local(hook, colourspaced);
+            image = colourspaced;
+          }
+          // Add non-transparent alpha channel, if required
+          if (output->background[3] < 255.0 && !HasAlpha(image)) {
+            // Create single-channel transparency
+            VipsImage *black;
+            if (vips_black(&black, image->Xsize, image->Ysize, "bands", 1, NULL)) {
+              return Error();
+            }
+            vips_object_local(hook, black);
+            // Invert to become non-transparent
+            VipsImage *alpha;
+            if (vips_invert(black, &alpha, NULL)) {
+              return Error();
+            }
+            vips_object_local(hook, alpha);
+            // Append alpha channel to existing image
+            VipsImage *joined;
+            if (vips_bandjoin2(image, alpha, &joined, NULL)) {
+              return Error();
+            }
+            vips_object_local(hook, joined);
+            image = joined;
+          }
+          // Create background
+          VipsArrayDouble *background;
+          if (output->background[3] < 255.0 || HasAlpha(image)) {
+            background = vips_array_double_newv(
+              4, output->background[0], output->background[1], output->background[2], output->background[3]
+            );
+          } else {
+            background = vips_array_double_newv(
+              3, output->background[0], output->background[1], output->background[2]
+            );
+          }
+          // Embed
+          int left = (output->width - image->Xsize) / 2;
+          int top = (output->height - image->Ysize) / 2;
+          VipsImage *embedded;
+          if (vips_embed(image, &embedded, left, top, output->width, output->height,
+            "extend", VIPS_EXTEND_BACKGROUND, "background", background, NULL
+          )) {
+            vips_area_unref(reinterpret_cast<VipsArea*>(background));
+            return Error();
+          }
+          vips_area_unref(reinterpret_cast<VipsArea*>(background));
+          vips_object_local(hook, embedded);
+          image = embedded;
+        } else if (output->canvas != Canvas::IGNORE_ASPECT) {
+          // Crop/max/min
+          int left;
+          int top;
+          if (IsCropStrategy(output->gravity)) {
+            std::tie(left, top) = CalculateCropAround(image->Xsize, image->Ysize, output->width, output->height,
+              output->cropCentreX, output->cropCentreY);
+            output->cropOffsetLeft = left;
+            output->cropOffsetTop = top;
+          } else {
+            std::tie(left, top) = CalculateCrop(image->Xsize, image->Ysize, output->width, output->height, output->gravity);
+          }
+          int width = std::min(image->Xsize, output->width);
+          int height = std::min(image->Ysize, output->height);
+          VipsImage *extracted;
+          if (vips_extract_area(image, &extracted, left, top, width, height, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, extracted);
+          image = extracted;
+        }
       }
-      vips_object_local(hook, gammaDecoded);
-      image = gammaDecoded;
-    }
 
-#ifndef _WIN32
-    // Apply normalization
-    if (baton->normalize) {
-      VipsInterpretation typeBeforeNormalize = image->Type;
-      if (typeBeforeNormalize == VIPS_INTERPRETATION_RGB) {
-        typeBeforeNormalize = VIPS_INTERPRETATION_sRGB;
+      // Post extraction
+      if (output->topOffsetPost != -1) {
+        VipsImage *extractedPost;
+        if (vips_extract_area(image, &extractedPost,
+          output->leftOffsetPost, output->topOffsetPost, output->widthPost, output->heightPost, NULL
+        )) {
+          return Error();
+        }
+        vips_object_local(hook, extractedPost);
+        image = extractedPost;
       }
 
-      // normalize the luminance band in LAB space:
-      VipsImage *lab;
-      if (vips_colourspace(image, &lab, VIPS_INTERPRETATION_LAB, NULL)) {
-        return Error();
+      // Blur
+      if (output->blurSigma != 0.0) {
+        VipsImage *blurred;
+        if (output->blurSigma < 0.0) {
+          // Fast, mild blur - averages neighbouring pixels
+          VipsImage *blur = GetMildBlur();
+          vips_object_local(hook, blur);
+          if (Convolve(image, &blurred, blur)) {
+            return Error();
+          }
+        } else {
+          // Slower, accurate Gaussian blur
+          // Create Gaussian function for standard deviation
+          VipsImage *gaussian = GetGaussian(output->blurSigma, 0.2);
+          if (gaussian == NULL) {
+            return Error();
+          }
+          vips_object_local(hook, gaussian);
+          // Apply Gaussian function
+          if (ConvolveSeparable(image, &blurred, gaussian)) {
+            return Error();
+          }
+        }
+        vips_object_local(hook, blurred);
+        image = blurred;
       }
-      vips_object_local(hook, lab);
 
-      VipsImage *luminance;
-      if (vips_extract_band(lab, &luminance, 0, "n", 1, NULL)) {
-        return Error();
+      // Sharpen
+      if (output->sharpenRadius != 0) {
+        VipsImage *sharpened;
+        if (output->sharpenRadius == -1) {
+          // Fast, mild sharpen
+          VipsImage *sharpen = GetMildSharpen();
+          vips_object_local(hook, sharpen);
+          if (Convolve(image, &sharpened, sharpen)) {
+            return Error();
+          }
+        } else {
+          // Slow, accurate sharpen in LAB colour space, with control over flat vs jagged areas
+          if (vips_sharpen(image, &sharpened,
+            "radius", output->sharpenRadius, "m1", output->sharpenFlat, "m2", output->sharpenJagged, NULL
+          )) {
+            return Error();
+          }
+        }
+        vips_object_local(hook, sharpened);
+        image = sharpened;
       }
-      vips_object_local(hook, luminance);
 
-      VipsImage *chroma;
-      if (vips_extract_band(lab, &chroma, 1, "n", 2, NULL)) {
-        return Error();
+      // Gamma decoding (brighten)
+      if (baton->gamma >= 1 && baton->gamma <= 3) {
+        VipsImage *gammaDecoded;
+        if (vips_gamma(image, &gammaDecoded, "exponent", baton->gamma, NULL)) {
+          return Error();
+        }
+        vips_object_local(hook, gammaDecoded);
+        image = gammaDecoded;
       }
-      vips_object_local(hook, chroma);
 
-      VipsImage *stats;
-      if (vips_stats(luminance, &stats, NULL)) {
-        return Error();
-      }
-      vips_object_local(hook, stats);
-      double min = *VIPS_MATRIX(stats, 0, 0);
-      double max = *VIPS_MATRIX(stats, 1, 0);
-
-      VipsImage *normalized;
-      if (min == max) {
-        // Range of zero: create black image
-        if (vips_black(&normalized, image->Xsize, image->Ysize, "bands", 1, NULL )) {
+#ifndef _WIN32
+      // Apply normalization
+      if (output->normalize && CanNormaliseInPlace(image)) {
+        // Render the shrunk image into memory, then stretch its luminance in place with a lookup table
+        VipsImage *memory;
+        if (Materialise(image, &memory)) {
           return Error();
         }
-        vips_object_local(hook, normalized);
-      } else {
-        double f = 100.0 / (max - min);
-        double a = -(min * f);
+        vips_object_local(hook, memory);
+        image = memory;
+        NormaliseInPlace(image, output->normalizeLower, output->normalizeUpper);
+      } else if (output->normalize) {
+        // Normalize the luminance band in LAB space, for images with a higher bit depth
+        VipsInterpretation typeBeforeNormalize = image->Type;
+        if (typeBeforeNormalize == VIPS_INTERPRETATION_RGB) {
+          typeBeforeNormalize = VIPS_INTERPRETATION_sRGB;
+        }
 
-        VipsImage *luminance100;
-        if (vips_linear1(luminance, &luminance100, f, a, NULL)) {
+        VipsImage *lab;
+        if (vips_colourspace(image, &lab, VIPS_INTERPRETATION_LAB, NULL)) {
           return Error();
         }
-        vips_object_local(hook, luminance100);
+        vips_object_local(hook, lab);
 
-        VipsImage *normalizedLab;
-        if (vips_bandjoin2(luminance100, chroma, &normalizedLab, NULL)) {
+        VipsImage *luminance;
+        if (vips_extract_band(lab, &luminance, 0, "n", 1, NULL)) {
           return Error();
         }
-        vips_object_local(hook, normalizedLab);
-        if (vips_colourspace(normalizedLab, &normalized, typeBeforeNormalize, NULL)) {
+        vips_object_local(hook, luminance);
+
+        VipsImage *chroma;
+        if (vips_extract_band(lab, &chroma, 1, "n", 2, NULL)) {
           return Error();
         }
-        vips_object_local(hook, normalized);
-      }
+        vips_object_local(hook, chroma);
 
-      if (HasAlpha(image)) {
-        VipsImage *alpha;
-        if (vips_extract_band(image, &alpha, image->Bands - 1, "n", 1, NULL)) {
+        VipsImage *stats;
+        if (vips_stats(luminance, &stats, NULL)) {
           return Error();
         }
-        vips_object_local(hook, alpha);
+        vips_object_local(hook, stats);
+        double min = *VIPS_MATRIX(stats, 0, 0);
+        double max = *VIPS_MATRIX(stats, 1, 0);
+
+        VipsImage *normalized;
+        if (min == max) {
+          // Range of zero: create black image
+          if (vips_black(&normalized, image->Xsize, image->Ysize, "bands", 1, NULL )) {
+            return Error();
+          }
+          vips_object_local(hook, normalized);
+        } else {
+          double f = 100.0 / (max - min);
+          double a = -(min * f);
 
-        VipsImage *normalizedAlpha;
-        if (vips_bandjoin2(normalized, alpha, &normalizedAlpha, NULL)) {
-          return Error();
+          VipsImage *luminance100;
+          if (vips_linear1(luminance, &luminance100, f, a, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, luminance100);
+
+          VipsImage *normalizedLab;
+          if (vips_bandjoin2(luminance100, chroma, &normalizedLab, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, normalizedLab);
+          if (vips_colourspace(normalizedLab, &normalized, typeBeforeNormalize, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, normalized);
+        }
+
+        if (HasAlpha(image)) {
+          VipsImage *alpha;
+          if (vips_extract_band(image, &alpha, image->Bands - 1, "n", 1, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, alpha);
+
+          VipsImage *normalizedAlpha;
+          if (vips_bandjoin2(normalized, alpha, &normalizedAlpha, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, normalizedAlpha);
+          image = normalizedAlpha;
+        } else {
+          image = normalized;
         }
-        vips_object_local(hook, normalizedAlpha);
-        image = normalizedAlpha;
-      } else {
-        image = normalized;
       }
-    }
 #endif
 
-    // Convert image to sRGB, if not already
-    if (image->Type != VIPS_INTERPRETATION_sRGB) {
-      // Switch intrepretation to sRGB
-      VipsImage *rgb;
-      if (vips_colourspace(image, &rgb, VIPS_INTERPRETATION_sRGB, NULL)) {
-        return Error();
-      }
-      vips_object_local(hook, rgb);
-      image = rgb;
-      // Tranform colours from embedded profile to sRGB profile
-      if (baton->withMetadata && HasProfile(image)) {
-        VipsImage *profiled;
-        if (vips_icc_transform(image, &profiled, srgbProfile.c_str(), "embedded", TRUE, NULL)) {
+      // Convert image to sRGB, if not already
+      if (image->Type != VIPS_INTERPRETATION_sRGB) {
+        // Switch intrepretation to sRGB
+        VipsImage *rgb;
+        if (vips_colourspace(image, &rgb, VIPS_INTERPRETATION_sRGB, NULL)) {
           return Error();
         }
-        vips_object_local(hook, profiled);
-        image = profiled;
+        vips_object_local(hook, rgb);
+        image = rgb;
+        // Tranform colours from embedded profile to sRGB profile
+        if (output->withMetadata && HasProfile(image) && !IsSrgbUchar(image, srgbProfile)) {
+          VipsImage *profiled;
+          if (vips_icc_transform(image, &profiled, srgbProfile.c_str(), "embedded", TRUE, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, profiled);
+          image = profiled;
+        }
       }
-    }
 
 #if !(VIPS_MAJOR_VERSION >= 8 || (VIPS_MAJOR_VERSION >= 7 && VIPS_MINOR_VERSION >= 40 && VIPS_MINOR_VERSION >= 5))
-    // Generate image tile cache when interlace output is required - no longer required as of libvips 7.40.5+
-    if (baton->progressive) {
-      VipsImage *cached;
-      if (vips_tilecache(image, &cached, "threaded", TRUE, "persistent", TRUE, "max_tiles", -1, NULL)) {
-        return Error();
+      // Generate image tile cache when interlace output is required - no longer required as of libvips 7.40.5+
+      if (output->progressive) {
+        VipsImage *cached;
+        if (vips_tilecache(image, &cached, "threaded", TRUE, "persistent", TRUE, "max_tiles", -1, NULL)) {
+          return Error();
+        }
+        vips_object_local(hook, cached);
+        image = cached;
       }
-      vips_object_local(hook, cached);
-      image = cached;
-    }
 #endif
 
-    // Output
-    if (baton->output == "__jpeg" || (baton->output == "__input" && inputImageType == ImageType::JPEG)) {
-      // Write JPEG to buffer
-      if (vips_jpegsave_buffer(image, &baton->bufferOut, &baton->bufferOutLength, "strip", !baton->withMetadata,
-        "Q", baton->quality, "optimize_coding", TRUE, "no_subsample", baton->withoutChromaSubsampling,
-#if (VIPS_MAJOR_VERSION >= 8)
-        "trellis_quant", baton->trellisQuantisation,
-        "overshoot_deringing", baton->overshootDeringing,
-        "optimize_scans", baton->optimiseScans,
-#endif
-        "interlace", baton->progressive, NULL)) {
-        return Error();
-      }
-      baton->outputFormat = "jpeg";
-    } else if (baton->output == "__png" || (baton->output == "__input" && inputImageType == ImageType::PNG)) {
-#if (VIPS_MAJOR_VERSION >= 8 || (VIPS_MAJOR_VERSION >= 7 && VIPS_MINOR_VERSION >= 42))
-      // Select PNG row filter
-      int filter = baton->withoutAdaptiveFiltering ? VIPS_FOREIGN_PNG_FILTER_NONE : VIPS_FOREIGN_PNG_FILTER_ALL;
-      // Write PNG to buffer
-      if (vips_pngsave_buffer(image, &baton->bufferOut, &baton->bufferOutLength, "strip", !baton->withMetadata,
-        "compression", baton->compressionLevel, "interlace", baton->progressive, "filter", filter, NULL)) {
-        return Error();
+      // Allow evaluation to be killed
+      Watch(image);
+
+      // Stream output in a sequential format is encoded straight into the pipe read by the Stream, as if it were a file.
+      // Opening a pipe by its /dev/fd path is POSIX-only, so on Windows all Stream output is encoded to a buffer.
+      std::string outputFile = output->output;
+#ifndef _WIN32
+      bool streamed = output->streamOutFd != -1 && (
+        output->output == "__jpeg" || output->output == "__png" || output->output == "__webp" || (output->output == "__input" &&
+        (inputImageType == ImageType::JPEG || inputImageType == ImageType::PNG || inputImageType == ImageType::WEBP))
+      );
+      if (streamed) {
+        outputFile = "/dev/fd/" + std::to_string(output->streamOutFd);
+        output->outputStreamed = TRUE;
       }
 #else
-      // Write PNG to buffer
-      if (vips_pngsave_buffer(image, &baton->bufferOut, &baton->bufferOutLength, "strip", !baton->withMetadata,
-        "compression", baton->compressionLevel, "interlace", baton->progressive, NULL)) {
-        return Error();
-      }
+      bool streamed = FALSE;
 #endif
-      baton->outputFormat = "png";
-    } else if (baton->output == "__webp" || (baton->output == "__input" && inputImageType == ImageType::WEBP)) {
-      // Write WEBP to buffer
-      if (vips_webpsave_buffer(image, &baton->bufferOut, &baton->bufferOutLength, "strip", !baton->withMetadata,
-        "Q", baton->quality, NULL)) {
-        return Error();
-      }
-      baton->outputFormat = "webp";
+      output->buildTime = Elapsed(mark);
+
+      // Output
+      if (!streamed && (output->output == "__jpeg" || (output->output == "__input" && inputImageType == ImageType::JPEG))) {
+        // Write JPEG to buffer
+        if (vips_jpegsave_buffer(image, &output->bufferOut, &output->bufferOutLength, "strip", !output->withMetadata,
+          "Q", output->quality, "optimize_coding", TRUE, "no_subsample", output->withoutChromaSubsampling,
+#if (VIPS_MAJOR_VERSION >= 8)
+          "trellis_quant", output->trellisQuantisation,
+          "overshoot_deringing", output->overshootDeringing,
+          "optimize_scans", output->optimiseScans,
+#endif
+          "interlace", output->progressive, NULL)) {
+          return Error();
+        }
+        output->outputFormat = "jpeg";
+      } else if (!streamed && (output->output == "__png" || (output->output == "__input" && inputImageType == ImageType::PNG))) {
 #if (VIPS_MAJOR_VERSION >= 8 || (VIPS_MAJOR_VERSION >= 7 && VIPS_MINOR_VERSION >= 42))
-    } else if (baton->output == "__raw") {
-      // Write raw, uncompressed image data to buffer
-      if (baton->greyscale || image->Type == VIPS_INTERPRETATION_B_W) {
-        // Extract first band for greyscale image
-        VipsImage *grey;
-        if (vips_extract_band(image, &grey, 0, NULL)) {
+        // Select PNG row filter
+        int filter = output->withoutAdaptiveFiltering ? VIPS_FOREIGN_PNG_FILTER_NONE : VIPS_FOREIGN_PNG_FILTER_ALL;
+        // Write PNG to buffer
+        if (vips_pngsave_buffer(image, &output->bufferOut, &output->bufferOutLength, "strip", !output->withMetadata,
+          "compression", output->compressionLevel, "interlace", output->progressive, "filter", filter, NULL)) {
           return Error();
         }
-        vips_object_local(hook, grey);
-        image = grey;
-      }
-      if (image->BandFmt != VIPS_FORMAT_UCHAR) {
-        // Cast pixels to uint8 (unsigned char)
-        VipsImage *uchar;
-        if (vips_cast(image, &uchar, VIPS_FORMAT_UCHAR, NULL)) {
+#else
+        // Write PNG to buffer
+        if (vips_pngsave_buffer(image, &output->bufferOut, &output->bufferOutLength, "strip", !output->withMetadata,
+          "compression", output->compressionLevel, "interlace", output->progressive, NULL)) {
           return Error();
         }
-        vips_object_local(hook, uchar);
-        image = uchar;
-      }
-      // Get raw image data
-      baton->bufferOut = vips_image_write_to_memory(image, &baton->bufferOutLength);
-      if (baton->bufferOut == NULL) {
-        (baton->err).append("Could not allocate enough memory for raw output");
-        return Error();
-      }
-      baton->outputFormat = "raw";
 #endif
-    } else {
-      bool outputJpeg = IsJpeg(baton->output);
-      bool outputPng = IsPng(baton->output);
-      bool outputWebp = IsWebp(baton->output);
-      bool outputTiff = IsTiff(baton->output);
-      bool outputDz = IsDz(baton->output);
-      bool matchInput = !(outputJpeg || outputPng || outputWebp || outputTiff || outputDz);
-      if (outputJpeg || (matchInput && inputImageType == ImageType::JPEG)) {
-        // Write JPEG to file
-        if (vips_jpegsave(image, baton->output.c_str(), "strip", !baton->withMetadata,
-          "Q", baton->quality, "optimize_coding", TRUE, "no_subsample", baton->withoutChromaSubsampling,
-#if (VIPS_MAJOR_VERSION >= 8)
-          "trellis_quant", baton->trellisQuantisation,
-          "overshoot_deringing", baton->overshootDeringing,
-          "optimize_scans", baton->optimiseScans,
-#endif
-          "interlace", baton->progressive, NULL)) {
+        output->outputFormat = "png";
+      } else if (!streamed && (output->output == "__webp" || (output->output == "__input" && inputImageType == ImageType::WEBP))) {
+        // Write WEBP to buffer
+        if (vips_webpsave_buffer(image, &output->bufferOut, &output->bufferOutLength, "strip", !output->withMetadata,
+          "Q", output->quality, NULL)) {
           return Error();
         }
-        baton->outputFormat = "jpeg";
-      } else if (outputPng || (matchInput && inputImageType == ImageType::PNG)) {
+        output->outputFormat = "webp";
 #if (VIPS_MAJOR_VERSION >= 8 || (VIPS_MAJOR_VERSION >= 7 && VIPS_MINOR_VERSION >= 42))
-        // Select PNG row filter
-        int filter = baton->withoutAdaptiveFiltering ? VIPS_FOREIGN_PNG_FILTER_NONE : VIPS_FOREIGN_PNG_FILTER_ALL;
-        // Write PNG to file
-        if (vips_pngsave(image, baton->output.c_str(), "strip", !baton->withMetadata,
-          "compression", baton->compressionLevel, "interlace", baton->progressive, "filter", filter, NULL)) {
+      } else if (output->output == "__raw") {
+        // Write raw, uncompressed image data to buffer
+        if (baton->greyscale || image->Type == VIPS_INTERPRETATION_B_W) {
+          // Extract first band for greyscale image
+          VipsImage *grey;
+          if (vips_extract_band(image, &grey, 0, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, grey);
+          image = grey;
+        }
+        if (image->BandFmt != VIPS_FORMAT_UCHAR) {
+          // Cast pixels to uint8 (unsigned char)
+          VipsImage *uchar;
+          if (vips_cast(image, &uchar, VIPS_FORMAT_UCHAR, NULL)) {
+            return Error();
+          }
+          vips_object_local(hook, uchar);
+          image = uchar;
+        }
+        // Get raw image data
+        output->bufferOut = vips_image_write_to_memory(image, &output->bufferOutLength);
+        if (output->bufferOut == NULL) {
+          (baton->err).append("Could not allocate enough memory for raw output");
           return Error();
         }
-#else
-        // Write PNG to file
-        if (vips_pngsave(image, baton->output.c_str(), "strip", !baton->withMetadata,
-          "compression", baton->compressionLevel, "interlace", baton->progressive, NULL)) {
+        output->outputFormat = "raw";
+#endif
+      } else if (output->output == "__tiff") {
+#if (VIPS_MAJOR_VERSION > 8 || (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION >= 5))
+        // Write TIFF to buffer
+        if (vips_tiffsave_buffer(image, &output->bufferOut, &output->bufferOutLength, "strip", !output->withMetadata,
+          "compression", TiffCompressionFromName(output->tiffCompression), "Q", output->quality,
+          "predictor", TiffPredictorFromName(output->tiffPredictor),
+          "tile", output->tiffTile || output->tiffPyramid, "tile_width", output->tiffTileSize, "tile_height", output->tiffTileSize,
+          "pyramid", output->tiffPyramid, NULL)) {
           return Error();
         }
+        output->outputFormat = "tiff";
+#else
+        (baton->err).append("TIFF output to a Buffer or Stream requires libvips 8.5.0+");
+        return Error();
 #endif
-        baton->outputFormat = "png";
-      } else if (outputWebp || (matchInput && inputImageType == ImageType::WEBP)) {
-        // Write WEBP to file
-        if (vips_webpsave(image, baton->output.c_str(), "strip", !baton->withMetadata,
-          "Q", baton->quality, NULL)) {
+      } else if (output->output == "__dz") {
+#if (VIPS_MAJOR_VERSION > 8 || (VIPS_MAJOR_VERSION == 8 && VIPS_MINOR_VERSION >= 9))
+        // Write DZ tiles, encoded in parallel, to a zip container in a buffer
+        if (vips_dzsave_buffer(image, &output->bufferOut, &output->bufferOutLength, "strip", !output->withMetadata,
+          "tile_size", output->tileSize, "overlap", output->tileOverlap,
+          "container", VIPS_FOREIGN_DZ_CONTAINER_ZIP, "compression", 0, NULL)) {
           return Error();
         }
-        baton->outputFormat = "webp";
-      } else if (outputTiff || (matchInput && inputImageType == ImageType::TIFF)) {
-        // Write TIFF to file
-        if (vips_tiffsave(image, baton->output.c_str(), "strip", !baton->withMetadata,
-          "compression", VIPS_FOREIGN_TIFF_COMPRESSION_JPEG, "Q", baton->quality, NULL)) {
+        output->outputFormat = "dz";
+#elif (VIPS_MAJOR_VERSION >= 8)
+        // Write DZ tiles, encoded in parallel, to a zip container in a temporary file, then read it into a buffer
+        GError *tmpError = NULL;
+        gchar *directory = g_dir_make_tmp("sharp-XXXXXX", &tmpError);
+        if (directory == NULL) {
+          (baton->err).append(tmpError->message);
+          g_error_free(tmpError);
           return Error();
         }
-        baton->outputFormat = "tiff";
-      } else if (outputDz) {
-        // Write DZ to file
-        if (vips_dzsave(image, baton->output.c_str(), "strip", !baton->withMetadata,
-            "tile_size", baton->tileSize, "overlap", baton->tileOverlap, NULL)) {
+        std::string zip = std::string(directory) + G_DIR_SEPARATOR_S + "image.zip";
+        gchar *contents = NULL;
+        gsize length = 0;
+        bool saved = !vips_dzsave(image, zip.c_str(), "strip", !output->withMetadata,
+          "tile_size", output->tileSize, "overlap", output->tileOverlap,
+          "container", VIPS_FOREIGN_DZ_CONTAINER_ZIP,
+#if (VIPS_MINOR_VERSION >= 8)
+          // Store the already compressed tiles without deflating them again
+          "compression", 0,
+#endif
+          NULL);
+        bool read = saved && g_file_get_contents(zip.c_str(), &contents, &length, NULL);
+        g_unlink(zip.c_str());
+        g_rmdir(directory);
+        g_free(directory);
+        if (!read) {
+          if (saved) {
+            (baton->err).append("Could not read Deep Zoom output from temporary file");
+          }
           return Error();
         }
-        baton->outputFormat = "dz";
-      } else {
-        (baton->err).append("Unsupported output " + baton->output);
+        output->bufferOut = contents;
+        output->bufferOutLength = length;
+        output->outputFormat = "dz";
+#else
+        (baton->err).append("Deep Zoom output to a Buffer or Stream requires libvips 8.0.0+");
         return Error();
+#endif
+      } else {
+        bool outputJpeg = IsJpeg(output->output) || output->output == "__jpeg";
+        bool outputPng = IsPng(output->output) || output->output == "__png";
+        bool outputWebp = IsWebp(output->output) || output->output == "__webp";
+        bool outputTiff = IsTiff(output->output);
+        bool outputDz = IsDz(output->output);
+        bool outputDzZip = IsDzZip(output->output);
+        bool matchInput = !(outputJpeg || outputPng || outputWebp || outputTiff || outputDz || outputDzZip);
+        if (outputJpeg || (matchInput && inputImageType == ImageType::JPEG)) {
+          // Write JPEG to file
+          if (vips_jpegsave(image, outputFile.c_str(), "strip", !output->withMetadata,
+            "Q", output->quality, "optimize_coding", TRUE, "no_subsample", output->withoutChromaSubsampling,
+#if (VIPS_MAJOR_VERSION >= 8)
+            "trellis_quant", output->trellisQuantisation,
+            "overshoot_deringing", output->overshootDeringing,
+            "optimize_scans", output->optimiseScans,
+#endif
+            "interlace", output->progressive, NULL)) {
+            return Error();
+          }
+          output->outputFormat = "jpeg";
+        } else if (outputPng || (matchInput && inputImageType == ImageType::PNG)) {
+#if (VIPS_MAJOR_VERSION >= 8 || (VIPS_MAJOR_VERSION >= 7 && VIPS_MINOR_VERSION >= 42))
+          // Select PNG row filter
+          int filter = output->withoutAdaptiveFiltering ? VIPS_FOREIGN_PNG_FILTER_NONE : VIPS_FOREIGN_PNG_FILTER_ALL;
+          // Write PNG to file
+          if (vips_pngsave(image, outputFile.c_str(), "strip", !output->withMetadata,
+            "compression", output->compressionLevel, "interlace", output->progressive, "filter", filter, NULL)) {
+            return Error();
+          }
+#else
+          // Write PNG to file
+          if (vips_pngsave(image, outputFile.c_str(), "strip", !output->withMetadata,
+            "compression", output->compressionLevel, "interlace", output->progressive, NULL)) {
+            return Error();
+          }
+#endif
+          output->outputFormat = "png";
+        } else if (outputWebp || (matchInput && inputImageType == ImageType::WEBP)) {
+          // Write WEBP to file
+          if (vips_webpsave(image, outputFile.c_str(), "strip", !output->withMetadata,
+            "Q", output->quality, NULL)) {
+            return Error();
+          }
+          output->outputFormat = "webp";
+        } else if (outputTiff || (matchInput && inputImageType == ImageType::TIFF)) {
+          // Write TIFF to file, optionally tiled and with a pyramid of reduced resolutions, which must also be tiled
+          if (vips_tiffsave(image, output->output.c_str(), "strip", !output->withMetadata,
+            "compression", TiffCompressionFromName(output->tiffCompression), "Q", output->quality,
+            "predictor", TiffPredictorFromName(output->tiffPredictor),
+            "tile", output->tiffTile || output->tiffPyramid, "tile_width", output->tiffTileSize, "tile_height", output->tiffTileSize,
+            "pyramid", output->tiffPyramid, NULL)) {
+            return Error();
+          }
+          output->outputFormat = "tiff";
+        } else if (outputDz) {
+          // Write DZ to file
+          if (vips_dzsave(image, output->output.c_str(), "strip", !output->withMetadata,
+              "tile_size", output->tileSize, "overlap", output->tileOverlap, NULL)) {
+            return Error();
+          }
+          output->outputFormat = "dz";
+        } else if (outputDzZip) {
+#if (VIPS_MAJOR_VERSION >= 8)
+          // Write DZ tiles, encoded in parallel, to a single zip file without an intermediate directory
+          if (vips_dzsave(image, output->output.c_str(), "strip", !output->withMetadata,
+              "tile_size", output->tileSize, "overlap", output->tileOverlap,
+              "container", VIPS_FOREIGN_DZ_CONTAINER_ZIP,
+#if (VIPS_MAJOR_VERSION > 8 || VIPS_MINOR_VERSION >= 8)
+              // Store the already compressed tiles without deflating them again
+              "compression", 0,
+#endif
+              NULL)) {
+            return Error();
+          }
+          output->outputFormat = "dz";
+#else
+          (baton->err).append("Deep Zoom output to a zip file requires libvips 8.0.0+");
+          return Error();
+#endif
+        } else {
+          (baton->err).append("Unsupported output " + output->output);
+          return Error();
+        }
       }
+      output->renderTime = Elapsed(mark);
+
+      // Record metrics of the output
+      guint64 bytes = output->bufferOutLength;
+      GStatBuf st;
+      if (bytes == 0 && !output->outputStreamed && !IsDz(outputFile) && g_stat(outputFile.c_str(), &st) == 0) {
+        bytes = static_cast<guint64>(st.st_size);
+      }
+      RecordOutput(output->outputFormat, bytes, static_cast<guint64>(image->Xsize) * static_cast<guint64>(image->Ysize));
+    }
+    if (baton->bufferOutLength > 0 && !baton->outputKey.empty()) {
+      // Share the output, by reference, with later tasks with the same input and options
+      baton->bufferOutBytes = g_bytes_new_take(baton->bufferOut, baton->bufferOutLength);
+      CachedOutput cached = { baton->bufferOutBytes, baton->outputFormat, 0, 0, baton->cropOffsetLeft, baton->cropOffsetTop };
+      std::tie(cached.width, cached.height) = OutputDimensions(baton);
+      PutOutput(baton->outputKey, cached);
     }
     // Clean up any dangling image references
     g_object_unref(hook);
-    // Clean up libvips' per-request data and threads
+    // Signal the end of any streamed output
+    CloseStreamOut();
+    // Clean up libvips' per-request data, keeping per-thread state for the next task on this pool thread
     vips_error_clear();
-    vips_thread_shutdown();
   }
 
   void HandleOKCallback () {
@@ -966,31 +1704,50 @@ class ResizeWorker : public NanAsyncWorker {
     if (!baton->err.empty()) {
       // Error
       argv[0] = Exception::Error(NanNew<String>(baton->err.data(), baton->err.size()));
-    } else {
-      int width = baton->width;
-      int height = baton->height;
-      if (baton->topOffsetPre != -1 && (baton->width == -1 || baton->height == -1)) {
-        width = baton->widthPre;
-        height = baton->heightPre;
+      if (!baton->errCode.empty()) {
+        argv[0]->ToObject()->Set(NanNew<String>("code"), NanNew<String>(baton->errCode));
+      }
+      // Free any renditions that completed before the error
+      for (ResizeBaton *rendition : baton->renditions) {
+        if (rendition->bufferOutLength > 0) {
+          g_free(rendition->bufferOut);
+        }
       }
-      if (baton->topOffsetPost != -1) {
-        width = baton->widthPost;
-        height = baton->heightPost;
+    } else if (!baton->renditions.empty()) {
+      // Array of { data, info } Objects, in the order the renditions were requested
+      Local<Array> renditions = NanNew<Array>(baton->renditions.size());
+      for (size_t i = 0; i < baton->renditions.size(); i++) {
+        ResizeBaton *rendition = baton->renditions[i];
+        Local<Object> info = Info(rendition);
+        Local<Object> result = NanNew<Object>();
+        // Wrap data in new Buffer, which takes ownership of memory allocated by libvips
+        result->Set(NanNew<String>("data"),
+          NanNewBufferHandle(static_cast<char*>(rendition->bufferOut), rendition->bufferOutLength, FreeBufferOut, NULL));
+        // Add buffer size to info
+        info->Set(NanNew<String>("size"), NanNew<Uint32>(static_cast<uint32_t>(rendition->bufferOutLength)));
+        result->Set(NanNew<String>("info"), info);
+        renditions->Set(i, result);
       }
+      argv[1] = renditions;
+    } else {
       // Info Object
-      Local<Object> info = NanNew<Object>();
-      info->Set(NanNew<String>("format"), NanNew<String>(baton->outputFormat));
-      info->Set(NanNew<String>("width"), NanNew<Uint32>(static_cast<uint32_t>(width)));
-      info->Set(NanNew<String>("height"), NanNew<Uint32>(static_cast<uint32_t>(height)));
-
-      if (baton->bufferOutLength > 0) {
-        // Copy data to new Buffer
-        argv[1] = NanNewBufferHandle(static_cast<char*>(baton->bufferOut), baton->bufferOutLength);
-        // bufferOut was allocated via g_malloc
-        g_free(baton->bufferOut);
+      Local<Object> info = Info(baton);
+      if (baton->bufferOutBytes != NULL) {
+        // Wrap data shared with the output cache in new Buffer, which takes ownership of a reference to it
+        argv[1] = NanNewBufferHandle(static_cast<char*>(baton->bufferOut), baton->bufferOutLength,
+          FreeBufferOutBytes, baton->bufferOutBytes);
+        // Add buffer size to info
+        info->Set(NanNew<String>("size"), NanNew<Uint32>(static_cast<uint32_t>(baton->bufferOutLength)));
+        argv[2] = info;
+      } else if (baton->bufferOutLength > 0) {
+        // Wrap data in new Buffer, which takes ownership of memory allocated by libvips
+        argv[1] = NanNewBufferHandle(static_cast<char*>(baton->bufferOut), baton->bufferOutLength, FreeBufferOut, NULL);
         // Add buffer size to info
         info->Set(NanNew<String>("size"), NanNew<Uint32>(static_cast<uint32_t>(baton->bufferOutLength)));
         argv[2] = info;
+      } else if (baton->outputStreamed) {
+        // Data was written incrementally to the Stream, which counts its size
+        argv[2] = info;
       } else {
         // Add file size to info
         GStatBuf st;
@@ -999,22 +1756,92 @@ class ResizeWorker : public NanAsyncWorker {
         argv[1] = info;
       }
     }
+    for (ResizeBaton *rendition : baton->renditions) {
+      delete rendition;
+    }
+    tasks.erase(taskId);
     delete baton;
 
     // Decrement processing task counter
     g_atomic_int_dec_and_test(&counterProcess);
     Handle<Value> queueLength[1] = { NanNew<Uint32>(counterQueue) };
     queueListener->Call(1, queueLength);
-    delete queueListener;
+    if (!sharedQueueListener) {
+      delete queueListener;
+    }
 
     // Return to JavaScript
     callback->Call(3, argv);
   }
 
+  /*
+    Fail the task without running it, for completion by the pool
+  */
+  void Reject(std::string const &reason) {
+    if (baton->bufferInCopy) {
+      delete[] baton->bufferIn;
+    }
+    CloseStreamOut();
+    (baton->err).append(reason);
+    baton->errCode = "EAGAIN";
+    // Balance the decrement of the processing task counter by HandleOKCallback
+    g_atomic_int_inc(&counterProcess);
+  }
+
  private:
   ResizeBaton *baton;
   NanCallback *queueListener;
+  bool sharedQueueListener;
+  int taskId;
+  size_t admittedMemory;
   VipsObject *hook;
+  ImageType inputImageType;
+
+  /*
+    Close the write end of the output pipe, if any, so the Stream reading from it sees the end of the data
+  */
+  void CloseStreamOut() {
+#ifndef _WIN32
+    if (baton->streamOutFd != -1) {
+      close(baton->streamOutFd);
+      baton->streamOutFd = -1;
+    }
+#endif
+  }
+
+  /*
+    Create the info Object describing the format and dimensions of an output image, and optionally how it was made
+  */
+  Local<Object> Info(ResizeBaton *output) {
+    int width;
+    int height;
+    std::tie(width, height) = OutputDimensions(output);
+    Local<Object> info = NanNew<Object>();
+    info->Set(NanNew<String>("format"), NanNew<String>(output->outputFormat));
+    info->Set(NanNew<String>("width"), NanNew<Uint32>(static_cast<uint32_t>(width)));
+    info->Set(NanNew<String>("height"), NanNew<Uint32>(static_cast<uint32_t>(height)));
+    if (output->cropOffsetLeft != -1) {
+      // Offsets of the crop chosen by content within the resized image, for use with extract
+      info->Set(NanNew<String>("cropOffsetLeft"), NanNew<Number>(output->cropOffsetLeft));
+      info->Set(NanNew<String>("cropOffsetTop"), NanNew<Number>(output->cropOffsetTop));
+    }
+    if (baton->timings) {
+      // Stages shared by all outputs are recorded by the baton, those specific to each output by its rendition
+      Local<Object> timings = NanNew<Object>();
+      timings->Set(NanNew<String>("queue"), NanNew<Number>(baton->queueTime / 1000.0));
+      timings->Set(NanNew<String>("open"), NanNew<Number>(baton->openTime / 1000.0));
+      timings->Set(NanNew<String>("reload"), NanNew<Number>(baton->reloadTime / 1000.0));
+      timings->Set(NanNew<String>("build"), NanNew<Number>(output->buildTime / 1000.0));
+      timings->Set(NanNew<String>("render"), NanNew<Number>(output->renderTime / 1000.0));
+      timings->Set(NanNew<String>("inputWidth"), NanNew<Uint32>(static_cast<uint32_t>(baton->inputWidth)));
+      timings->Set(NanNew<String>("inputHeight"), NanNew<Uint32>(static_cast<uint32_t>(baton->inputHeight)));
+      timings->Set(NanNew<String>("shrinkOnLoad"), NanNew<Uint32>(static_cast<uint32_t>(baton->shrinkOnLoad)));
+      timings->Set(NanNew<String>("xshrink"), NanNew<Uint32>(static_cast<uint32_t>(output->xshrink)));
+      timings->Set(NanNew<String>("yshrink"), NanNew<Uint32>(static_cast<uint32_t>(output->yshrink)));
+      info->Set(NanNew<String>("timings"), timings);
+    }
+    return info;
+  }
 
   /*
     Calculate the angle of rotation and need-to-flip for the output image.
@@ -1049,6 +1876,77 @@ class ResizeWorker : public NanAsyncWorker {
     return std::make_tuple(rotate, flip);
   }
 
+  /*
+    Calculate the x and y scaling factors required to reach the output dimensions.
+    Updates the output width and/or height where the canvas allows these to be derived.
+  */
+  std::tuple<double, double>
+  CalculateFactors(ResizeBaton *output, int const inputWidth, int const inputHeight) {
+    double xfactor = 1.0;
+    double yfactor = 1.0;
+    if (output->width > 0 && output->height > 0) {
+      // Fixed width and height
+      xfactor = static_cast<double>(inputWidth) / static_cast<double>(output->width);
+      yfactor = static_cast<double>(inputHeight) / static_cast<double>(output->height);
+      switch (output->canvas) {
+        case Canvas::CROP:
+          xfactor = std::min(xfactor, yfactor);
+          yfactor = xfactor;
+          break;
+        case Canvas::EMBED:
+          xfactor = std::max(xfactor, yfactor);
+          yfactor = xfactor;
+          break;
+        case Canvas::MAX:
+          if (xfactor > yfactor) {
+            output->height = static_cast<int>(round(static_cast<double>(inputHeight) / xfactor));
+            yfactor = xfactor;
+          } else {
+            output->width = static_cast<int>(round(static_cast<double>(inputWidth) / yfactor));
+            xfactor = yfactor;
+          }
+          break;
+        case Canvas::MIN:
+          if (xfactor < yfactor) {
+            output->height = static_cast<int>(round(static_cast<double>(inputHeight) / xfactor));
+            yfactor = xfactor;
+          } else {
+            output->width = static_cast<int>(round(static_cast<double>(inputWidth) / yfactor));
+            xfactor = yfactor;
+          }
+          break;
+        case Canvas::IGNORE_ASPECT:
+          // xfactor, yfactor OK!
+          break;
+      }
+    } else if (output->width > 0) {
+      // Fixed width
+      xfactor = static_cast<double>(inputWidth) / static_cast<double>(output->width);
+      if (output->canvas == Canvas::IGNORE_ASPECT) {
+        output->height = inputHeight;
+      } else {
+        // Auto height
+        yfactor = xfactor;
+        output->height = static_cast<int>(floor(static_cast<double>(inputHeight) / yfactor));
+      }
+    } else if (output->height > 0) {
+      // Fixed height
+      yfactor = static_cast<double>(inputHeight) / static_cast<double>(output->height);
+      if (output->canvas == Canvas::IGNORE_ASPECT) {
+        output->width = inputWidth;
+      } else {
+        // Auto width
+        xfactor = yfactor;
+        output->width = static_cast<int>(floor(static_cast<double>(inputWidth) / xfactor));
+      }
+    } else {
+      // Identity transform
+      output->width = inputWidth;
+      output->height = inputHeight;
+    }
+    return std::make_tuple(xfactor, yfactor);
+  }
+
   /*
     Calculate the (left, top) coordinates of the output image
     within the input image, applying the given gravity.
@@ -1079,6 +1977,23 @@ class ResizeWorker : public NanAsyncWorker {
     return std::make_tuple(left, top);
   }
 
+  /*
+    Calculate the (offset, length) of the input covered by a Deep Zoom tile along one axis, and the tile length.
+    Levels are the input shrunk by the given power of two and rounded up, as generated by vips_dzsave.
+    The tile length is zero when the tile is outside the level.
+  */
+  std::tuple<int, int, int>
+  CalculateTileSpan(int const inSize, int const scale, int const size, int const overlap, int const index) {
+    int levelSize = (inSize + scale - 1) / scale;
+    if (index >= (levelSize + size - 1) / size) {
+      return std::make_tuple(0, 0, 0);
+    }
+    int start = std::max(0, index * size - overlap);
+    int end = std::min(levelSize, (index + 1) * size + overlap);
+    int offset = start * scale;
+    return std::make_tuple(offset, std::min(inSize, end * scale) - offset, end - start);
+  }
+
   /*
     Calculate integral shrink given factor and interpolator window size
   */
@@ -1103,44 +2018,218 @@ class ResizeWorker : public NanAsyncWorker {
     return static_cast<double>(shrink) / factor;
   }
 
+  /*
+    Render an image into memory so it can be read many times without re-evaluating its pipeline
+  */
+  int Materialise(VipsImage *image, VipsImage **out) {
+    Watch(image);
+    VipsImage *memory = vips_image_new_memory();
+    if (vips_image_write(image, memory)) {
+      g_object_unref(memory);
+      return -1;
+    }
+    *out = memory;
+    return 0;
+  }
+
+  /*
+    Wrap an image shared with other tasks, such as a cached intermediate, in one owned by this task, so that watching
+    its evaluation neither leaves a handler bound to this task's baton on the shared image nor can kill it
+  */
+  int Own(VipsImage *shared, VipsImage **out) {
+    return vips_copy(shared, out, NULL);
+  }
+
+  /*
+    Signal the "eval" progress of an image, so its evaluation can be killed when the task is stopped
+  */
+  void Watch(VipsImage *image) {
+    vips_image_set_progress(image, TRUE);
+    g_signal_connect(image, "eval", G_CALLBACK(StopEval), baton);
+  }
+
+  /*
+    Complete the task with a cached output, holding a reference to its data, instead of processing it.
+    Stream output receives the data as a single Buffer.
+  */
+  void Cached(CachedOutput const &output) {
+    if (baton->bufferInCopy) {
+      delete[] baton->bufferIn;
+    }
+    CloseStreamOut();
+    baton->bufferOutBytes = output.data;
+    baton->bufferOut = const_cast<void*>(g_bytes_get_data(output.data, NULL));
+    baton->bufferOutLength = g_bytes_get_size(output.data);
+    baton->outputFormat = output.format;
+    baton->width = output.width;
+    baton->height = output.height;
+    baton->cropOffsetLeft = output.cropOffsetLeft;
+    baton->cropOffsetTop = output.cropOffsetTop;
+    baton->topOffsetPost = -1;
+    // The cached output is not added to the cache again
+    baton->outputKey.clear();
+  }
+
+  /*
+    Set the error message and code of a task that was cancelled or passed its deadline
+  */
+  void Stopped() {
+    if (g_atomic_int_get(&baton->cancelled)) {
+      (baton->err).append("Processing cancelled");
+      baton->errCode = "ECANCELED";
+    } else {
+      (baton->err).append("Processing timed out");
+      baton->errCode = "ETIMEDOUT";
+    }
+  }
+
   /*
     Copy then clear the error message.
     Unref all transitional images on the hook.
-    Clear all thread-local data.
   */
   void Error() {
-    // Get libvips' error message
-    (baton->err).append(vips_error_buffer());
+    // Get libvips' error message, unless evaluation was killed
+    if (IsStopped(baton)) {
+      Stopped();
+    } else {
+      (baton->err).append(vips_error_buffer());
+    }
     // Clean up any dangling image references
     g_object_unref(hook);
-    // Clean up libvips' per-request data and threads
+    // Signal the end of any streamed output
+    CloseStreamOut();
+    // Clean up libvips' per-request data, keeping per-thread state for the next task on this pool thread
     vips_error_clear();
-    vips_thread_shutdown();
   }
 };
 
 /*
-  resize(options, output, callback)
+  Convert the "canvas" attribute of an options Object to its enum value
 */
-NAN_METHOD(resize) {
-  NanScope();
+static Canvas CanvasFromOptions(Local<Object> options, Canvas const fallback) {
+  Canvas canvas = fallback;
+  Local<String> name = options->Get(NanNew<String>("canvas"))->ToString();
+  if (name->Equals(NanNew<String>("crop"))) {
+    canvas = Canvas::CROP;
+  } else if (name->Equals(NanNew<String>("embed"))) {
+    canvas = Canvas::EMBED;
+  } else if (name->Equals(NanNew<String>("max"))) {
+    canvas = Canvas::MAX;
+  } else if (name->Equals(NanNew<String>("min"))) {
+    canvas = Canvas::MIN;
+  } else if (name->Equals(NanNew<String>("ignore_aspect"))) {
+    canvas = Canvas::IGNORE_ASPECT;
+  }
+  return canvas;
+}
 
-  // V8 objects are converted to non-V8 types held in the baton struct
-  ResizeBaton *baton = new ResizeBaton;
-  Local<Object> options = args[0]->ToObject();
+/*
+  Read the header of a task's input, if possible without decoding it.
+  This runs on the JS thread, so only input already held in memory is read. A file is not opened here,
+  leaving file input with an unknown header.
+*/
+static bool ReadInputHeader(ResizeBaton const *baton, ImageHeader &header) {
+  if (!baton->bufferInChunks.empty()) {
+    // The header is usually within the first chunk of streamed input
+    return ParseHeader(baton->bufferInChunks.front().first, baton->bufferInChunks.front().second, header);
+  } else if (baton->bufferInLength > 0) {
+    return ParseHeader(baton->bufferIn, baton->bufferInLength, header);
+  } else {
+    return false;
+  }
+}
 
+/*
+  Estimate the peak memory, in bytes, of a task from its input header and the operations it will perform.
+  Random access decodes the whole input, after any shrink-on-load, into memory whereas sequential access
+  holds only a strip of it. Each output adds its uncompressed pixels, as do the intermediates materialised
+  for renditions.
+*/
+static size_t EstimateMemory(ResizeBaton const *baton, ImageHeader const &header) {
+  double const bytesPerBand = (header.space == "grey16" || header.space == "rgb16") ? 2.0 : 1.0;
+  double const pixelBytes = header.channels * bytesPerBand;
+  std::vector<ResizeBaton const*> outputs;
+  if (baton->renditions.empty()) {
+    outputs.push_back(baton);
+  } else {
+    outputs.assign(baton->renditions.begin(), baton->renditions.end());
+  }
+  // Smallest shrink factor of any output, which bounds the shrink-on-load libvips can use
+  double shrink = 1.0;
+  bool const shrinkOnLoad = (header.type == ImageType::JPEG || header.type == ImageType::WEBP) &&
+    baton->gamma == 0 && baton->topOffsetPre == -1;
+  if (shrinkOnLoad) {
+    shrink = std::numeric_limits<double>::max();
+    for (ResizeBaton const *output : outputs) {
+      double xfactor = output->width > 0 ? static_cast<double>(header.width) / output->width : 1.0;
+      double yfactor = output->height > 0 ? static_cast<double>(header.height) / output->height : 1.0;
+      double factor = (output->width > 0 && output->height > 0) ? std::min(xfactor, yfactor) : std::max(xfactor, yfactor);
+      shrink = std::min(shrink, std::max(factor, 1.0));
+    }
+    if (header.type == ImageType::JPEG) {
+      shrink = shrink >= 8 ? 8 : shrink >= 4 ? 4 : shrink >= 2 ? 2 : 1;
+    } else {
+      shrink = std::floor(shrink);
+    }
+  }
+  double const loadWidth = std::ceil(header.width / shrink);
+  double const loadHeight = std::ceil(header.height / shrink);
+  double memory = baton->accessMethod == VIPS_ACCESS_SEQUENTIAL
+    ? loadWidth * std::min(loadHeight, 256.0) * pixelBytes
+    : loadWidth * loadHeight * pixelBytes;
+  for (ResizeBaton const *output : outputs) {
+    double width = output->width > 0 ? output->width : loadWidth;
+    double height = output->height > 0 ? output->height : loadHeight;
+    if (output->width > 0 && output->height <= 0) {
+      height = std::ceil(output->width * loadHeight / loadWidth);
+    } else if (output->height > 0 && output->width <= 0) {
+      width = std::ceil(output->height * loadWidth / loadHeight);
+    }
+    double outputBytes = width * height * pixelBytes;
+    memory += baton->renditions.empty() ? outputBytes : 2.0 * outputBytes;
+  }
+  return static_cast<size_t>(std::min(memory, static_cast<double>(std::numeric_limits<size_t>::max())));
+}
+
+/*
+  Convert the input options, a file or a Buffer, or chunks thereof, to their baton fields.
+  Returns the Buffer, or Array of chunks, to keep referenced while in use.
+*/
+static Local<Object> ReadInputOptions(Local<Object> options, ResizeBaton *baton) {
   // Input filename
   baton->fileIn = *String::Utf8Value(options->Get(NanNew<String>("fileIn"))->ToString());
-  baton->accessMethod = options->Get(NanNew<String>("sequentialRead"))->BooleanValue() ? VIPS_ACCESS_SEQUENTIAL : VIPS_ACCESS_RANDOM;
-  // Input Buffer object
-  if (options->Get(NanNew<String>("bufferIn"))->IsObject()) {
-    Local<Object> buffer = options->Get(NanNew<String>("bufferIn"))->ToObject();
-    // Take a copy of the input Buffer to avoid problems with V8 heap compaction
+  // Input Buffer object, or Array of Buffer chunks from a Stream
+  Local<Object> buffer;
+  if (options->Get(NanNew<String>("bufferIn"))->IsArray()) {
+    buffer = options->Get(NanNew<String>("bufferIn"))->ToObject();
+    Local<Array> chunks = Local<Array>::Cast(buffer);
+    for (unsigned int i = 0; i < chunks->Length(); i++) {
+      Local<Object> chunk = chunks->Get(i)->ToObject();
+      baton->bufferInChunks.push_back(std::make_pair(node::Buffer::Data(chunk), node::Buffer::Length(chunk)));
+      baton->bufferInLength += node::Buffer::Length(chunk);
+    }
+  } else if (options->Get(NanNew<String>("bufferIn"))->IsObject()) {
+    buffer = options->Get(NanNew<String>("bufferIn"))->ToObject();
     baton->bufferInLength = node::Buffer::Length(buffer);
-    baton->bufferIn = new char[baton->bufferInLength];
-    memcpy(baton->bufferIn, node::Buffer::Data(buffer), baton->bufferInLength);
-    options->Set(NanNew<String>("bufferIn"), NanNull());
+    baton->bufferInCopy = options->Get(NanNew<String>("copyInput"))->BooleanValue();
+    if (baton->bufferInCopy) {
+      // Take a copy of the input Buffer, leaving the caller free to modify it
+      baton->bufferIn = new char[baton->bufferInLength];
+      memcpy(baton->bufferIn, node::Buffer::Data(buffer), baton->bufferInLength);
+      options->Set(NanNew<String>("bufferIn"), NanNull());
+    } else {
+      // Read the input Buffer in place, referenced by the worker until the task completes
+      baton->bufferIn = node::Buffer::Data(buffer);
+    }
   }
+  return buffer;
+}
+
+/*
+  Convert the processing options, which are all but those of the input, to their baton fields
+*/
+static void ReadProcessingOptions(Local<Object> options, ResizeBaton *baton) {
+  baton->accessMethod = options->Get(NanNew<String>("sequentialRead"))->BooleanValue() ? VIPS_ACCESS_SEQUENTIAL : VIPS_ACCESS_RANDOM;
   // ICC profile to use when input CMYK image has no embedded profile
   baton->iccProfilePath = *String::Utf8Value(options->Get(NanNew<String>("iccProfilePath"))->ToString());
   // Limit input images to a given number of pixels, where pixels = width * height
@@ -1158,18 +2247,7 @@ NAN_METHOD(resize) {
   baton->width = options->Get(NanNew<String>("width"))->Int32Value();
   baton->height = options->Get(NanNew<String>("height"))->Int32Value();
   // Canvas option
-  Local<String> canvas = options->Get(NanNew<String>("canvas"))->ToString();
-  if (canvas->Equals(NanNew<String>("crop"))) {
-    baton->canvas = Canvas::CROP;
-  } else if (canvas->Equals(NanNew<String>("embed"))) {
-    baton->canvas = Canvas::EMBED;
-  } else if (canvas->Equals(NanNew<String>("max"))) {
-    baton->canvas = Canvas::MAX;
-  } else if (canvas->Equals(NanNew<String>("min"))) {
-    baton->canvas = Canvas::MIN;
-  } else if (canvas->Equals(NanNew<String>("ignore_aspect"))) {
-    baton->canvas = Canvas::IGNORE_ASPECT;
-  }
+  baton->canvas = CanvasFromOptions(options, baton->canvas);
   // Background colour
   Local<Array> background = Local<Array>::Cast(options->Get(NanNew<String>("background")));
   for (int i = 0; i < 4; i++) {
@@ -1188,6 +2266,8 @@ NAN_METHOD(resize) {
   baton->gamma = options->Get(NanNew<String>("gamma"))->NumberValue();
   baton->greyscale = options->Get(NanNew<String>("greyscale"))->BooleanValue();
   baton->normalize = options->Get(NanNew<String>("normalize"))->BooleanValue();
+  baton->normalizeLower = options->Get(NanNew<String>("normalizeLower"))->NumberValue();
+  baton->normalizeUpper = options->Get(NanNew<String>("normalizeUpper"))->NumberValue();
   baton->angle = options->Get(NanNew<String>("angle"))->Int32Value();
   baton->rotateBeforePreExtract = options->Get(NanNew<String>("rotateBeforePreExtract"))->BooleanValue();
   baton->flip = options->Get(NanNew<String>("flip"))->BooleanValue();
@@ -1206,17 +2286,226 @@ NAN_METHOD(resize) {
   baton->output = *String::Utf8Value(options->Get(NanNew<String>("output"))->ToString());
   baton->tileSize = options->Get(NanNew<String>("tileSize"))->Int32Value();
   baton->tileOverlap = options->Get(NanNew<String>("tileOverlap"))->Int32Value();
-  // Function to notify of queue length changes
-  NanCallback *queueListener = new NanCallback(Handle<Function>::Cast(options->Get(NanNew<String>("queueListener"))));
+  baton->tileLevel = options->Get(NanNew<String>("tileLevel"))->Int32Value();
+  baton->tileColumn = options->Get(NanNew<String>("tileColumn"))->Int32Value();
+  baton->tileRow = options->Get(NanNew<String>("tileRow"))->Int32Value();
+  baton->tiffTile = options->Get(NanNew<String>("tiffTile"))->BooleanValue();
+  baton->tiffTileSize = options->Get(NanNew<String>("tiffTileSize"))->Int32Value();
+  baton->tiffPyramid = options->Get(NanNew<String>("tiffPyramid"))->BooleanValue();
+  baton->tiffCompression = *String::Utf8Value(options->Get(NanNew<String>("tiffCompression"))->ToString());
+  baton->tiffPredictor = *String::Utf8Value(options->Get(NanNew<String>("tiffPredictor"))->ToString());
+  // Renditions, each inheriting all other options but with its own dimensions, canvas and output format
+  if (options->Get(NanNew<String>("renditions"))->IsArray()) {
+    Local<Array> renditions = Local<Array>::Cast(options->Get(NanNew<String>("renditions")));
+    for (unsigned int i = 0; i < renditions->Length(); i++) {
+      Local<Object> rendition = renditions->Get(i)->ToObject();
+      ResizeBaton *output = new ResizeBaton(*baton);
+      output->width = rendition->Get(NanNew<String>("width"))->Int32Value();
+      output->height = rendition->Get(NanNew<String>("height"))->Int32Value();
+      output->canvas = CanvasFromOptions(rendition, baton->canvas);
+      output->gravity = rendition->Get(NanNew<String>("gravity"))->Int32Value();
+      output->withoutEnlargement = rendition->Get(NanNew<String>("withoutEnlargement"))->BooleanValue();
+      output->output = *String::Utf8Value(rendition->Get(NanNew<String>("output"))->ToString());
+      output->quality = rendition->Get(NanNew<String>("quality"))->Int32Value();
+      output->progressive = rendition->Get(NanNew<String>("progressive"))->BooleanValue();
+      output->compressionLevel = rendition->Get(NanNew<String>("compressionLevel"))->Int32Value();
+      baton->renditions.push_back(output);
+    }
+    // The decoded input is read once per rendition, which requires random access
+    baton->accessMethod = VIPS_ACCESS_RANDOM;
+  }
+  // Scheduling options
+  baton->priority = PriorityFromName(*String::Utf8Value(options->Get(NanNew<String>("priority"))->ToString()));
+  baton->timeout = options->Get(NanNew<String>("timeout"))->Int32Value();
+  baton->timings = options->Get(NanNew<String>("timings"))->BooleanValue();
+}
+
+/*
+  Queue a task for a baton holding all its options, referencing its input buffer while in use.
+  Returns the read end of the pipe for Stream output, if any, else -1.
+*/
+static int QueueTask(ResizeBaton *baton, Local<Object> buffer, NanCallback *callback, NanCallback *queueListener,
+  bool const sharedQueueListener, bool const streamOut, int &taskId) {
+  // Stream output is written incrementally to a pipe, the read end of which is returned to JavaScript
+  int streamOutFd = -1;
+#ifndef _WIN32
+  if (streamOut && baton->renditions.empty()) {
+    int fds[2];
+    if (pipe(fds) == 0) {
+      fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+      fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+      streamOutFd = fds[0];
+      baton->streamOutFd = fds[1];
+    }
+  }
+#endif
+  // Deadline, from now, in milliseconds
+  if (baton->timeout > 0) {
+    baton->deadline = g_get_monotonic_time() + static_cast<gint64>(baton->timeout) * 1000;
+  }
+  // Record stage timings, from now, to report in info
+  baton->queuedAt = g_get_monotonic_time();
+  // Identify the task so it can be cancelled
+  taskId = nextTaskId++;
+  tasks[taskId] = baton;
 
   // Join queue for worker thread
+  ResizeWorker *worker = new ResizeWorker(callback, baton, queueListener, sharedQueueListener, taskId);
+  if (baton->bufferInLength > 0 && !baton->bufferInCopy) {
+    // Prevent garbage collection of the input Buffer, or chunks thereof, while in use
+    worker->SaveToPersistent("bufferIn", buffer);
+  }
+  if (QueueFull()) {
+    // Reject immediately, rather than adding to an already full queue
+    worker->Reject("Queue is full");
+    CompleteWorker(worker);
+    g_atomic_int_inc(&counterRejected);
+  } else {
+    // The input header provides the cost, as a number of pixels, for shortest-job-first ordering and the
+    // memory estimate for admission control. Inputs with an unreadable header are queued with an unknown cost, ranked
+    // as typical, and admitted regardless of the memory budget. The header of file input is not read on this thread,
+    // so it is queued likewise and read by the worker, which then records its cost and waits to be admitted.
+    double cost = 0.0;
+    size_t memory = 0;
+    if (ShortestJobFirst() || MemoryBudget() > 0) {
+      ImageHeader header;
+      if (ReadInputHeader(baton, header)) {
+        cost = static_cast<double>(header.width) * static_cast<double>(header.height);
+        memory = EstimateMemory(baton, header);
+      } else {
+        cost = -1.0;
+        baton->headerOnWorker = baton->bufferInLength == 0 && baton->bufferInChunks.empty();
+      }
+    }
+    QueueWorker(worker, baton->priority, cost, memory);
+
+    // Increment queued task counter
+    g_atomic_int_inc(&counterQueue);
+    Handle<Value> queueLength[1] = { NanNew<Uint32>(counterQueue) };
+    queueListener->Call(1, queueLength);
+  }
+
+  return streamOutFd;
+}
+
+/*
+  resize(options, output, callback)
+*/
+NAN_METHOD(resize) {
+  NanScope();
+
+  // V8 objects are converted to non-V8 types held in the baton struct
+  ResizeBaton *baton = new ResizeBaton;
+  Local<Object> options = args[0]->ToObject();
+  Local<Object> buffer = ReadInputOptions(options, baton);
+  ReadProcessingOptions(options, baton);
+
+  // Function to notify of queue length changes
+  NanCallback *queueListener = new NanCallback(Handle<Function>::Cast(options->Get(NanNew<String>("queueListener"))));
   NanCallback *callback = new NanCallback(args[1].As<Function>());
-  NanAsyncQueueWorker(new ResizeWorker(callback, baton, queueListener));
+  int taskId;
+  int streamOutFd = QueueTask(baton, buffer, callback, queueListener, FALSE,
+    options->Get(NanNew<String>("streamOut"))->BooleanValue(), taskId);
+  options->Set(NanNew<String>("taskId"), NanNew<Integer>(taskId));
+
+  if (streamOutFd != -1) {
+    NanReturnValue(NanNew<Integer>(streamOutFd));
+  }
+  NanReturnUndefined();
+}
+
+/*
+  cancel(taskId)
+  Stop a queued or running task, which then calls back with an Error
+*/
+NAN_METHOD(cancel) {
+  NanScope();
+
+  std::map<int, ResizeBaton*>::iterator task = tasks.find(args[0]->Int32Value());
+  if (task != tasks.end()) {
+    g_atomic_int_set(&task->second->cancelled, 1);
+  }
+  NanReturnUndefined();
+}
+
+/*
+  Compiled pipelines, each a template of the processing options of a task
+*/
+static std::map<int, ResizeBaton*> pipelines;
+static int nextPipelineId = 1;
+
+// Function to notify of queue length changes, shared by the tasks of all pipelines
+static NanCallback *pipelineQueueListener = NULL;
+
+/*
+  pipeline(options)
+  Convert processing options, once, to an immutable template, returning its identifier
+*/
+NAN_METHOD(pipeline) {
+  NanScope();
+
+  Local<Object> options = args[0]->ToObject();
+  ResizeBaton *baton = new ResizeBaton;
+  ReadProcessingOptions(options, baton);
+  baton->bufferInCopy = options->Get(NanNew<String>("copyInput"))->BooleanValue();
+  if (pipelineQueueListener == NULL) {
+    pipelineQueueListener = new NanCallback(Handle<Function>::Cast(options->Get(NanNew<String>("queueListener"))));
+  }
+  int id = nextPipelineId++;
+  pipelines[id] = baton;
+  NanReturnValue(NanNew<Integer>(id));
+}
+
+/*
+  pipelineResize(id, input, output, callback)
+  Process a file or Buffer input using a pipeline, writing to a file or, when output is empty, as per its template.
+  Returns the task identifier, for cancellation.
+*/
+NAN_METHOD(pipelineResize) {
+  NanScope();
 
-  // Increment queued task counter
-  g_atomic_int_inc(&counterQueue);
-  Handle<Value> queueLength[1] = { NanNew<Uint32>(counterQueue) };
-  queueListener->Call(1, queueLength);
+  std::map<int, ResizeBaton*>::iterator pipeline = pipelines.find(args[0]->Int32Value());
+  if (pipeline == pipelines.end()) {
+    return NanThrowError("Unknown pipeline");
+  }
+  ResizeBaton *baton = new ResizeBaton(*pipeline->second);
+  // Input filename or Buffer object
+  Local<Object> buffer;
+  if (args[1]->IsString()) {
+    baton->fileIn = *String::Utf8Value(args[1]->ToString());
+  } else {
+    buffer = args[1]->ToObject();
+    baton->bufferInLength = node::Buffer::Length(buffer);
+    if (baton->bufferInCopy) {
+      // Take a copy of the input Buffer, leaving the caller free to modify it
+      baton->bufferIn = new char[baton->bufferInLength];
+      memcpy(baton->bufferIn, node::Buffer::Data(buffer), baton->bufferInLength);
+    } else {
+      baton->bufferIn = node::Buffer::Data(buffer);
+    }
+  }
+  // Output filename, else the template's __format for Buffer
+  std::string output = *String::Utf8Value(args[2]->ToString());
+  if (!output.empty()) {
+    baton->output = output;
+  }
+  NanCallback *callback = new NanCallback(args[3].As<Function>());
+  int taskId;
+  QueueTask(baton, buffer, callback, pipelineQueueListener, TRUE, FALSE, taskId);
+  NanReturnValue(NanNew<Integer>(taskId));
+}
+
+/*
+  pipelineRelease(id)
+  Free a pipeline template. Tasks already started with it are unaffected.
+*/
+NAN_METHOD(pipelineRelease) {
+  NanScope();
 
+  std::map<int, ResizeBaton*>::iterator pipeline = pipelines.find(args[0]->Int32Value());
+  if (pipeline != pipelines.end()) {
+    delete pipeline->second;
+    pipelines.erase(pipeline);
+  }
   NanReturnUndefined();
 }
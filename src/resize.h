@@ -4,5 +4,9 @@
 #include "nan.h"
 
 NAN_METHOD(resize);
+NAN_METHOD(cancel);
+NAN_METHOD(pipeline);
+NAN_METHOD(pipelineResize);
+NAN_METHOD(pipelineRelease);
 
 #endif  // SRC_RESIZE_H_
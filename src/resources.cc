@@ -0,0 +1,156 @@
+#include <map>
+#include <string>
+#include <utility>
+#include <vips/vips.h>
+
+#include "resources.h"
+
+namespace sharp {
+
+  static GMutex mutex;
+  static std::map<std::string, VipsInterpolate*> interpolators;
+  static std::map<std::pair<double, double>, VipsImage*> kernels;
+  static std::map<std::string, VipsImage*> matrices;
+  static std::map<std::string, std::string> profiles;
+  static double hits = 0;
+  static double misses = 0;
+
+  // Sigma varies with the residual scale of each task, so bound the number of kernels kept
+  static size_t const maxKernels = 128;
+
+  /*
+    Find a cached object and take a new reference to it. Caller must hold the mutex.
+  */
+  template <typename K, typename T>
+  static T* Find(std::map<K, T*> &cache, K const &key) {
+    auto entry = cache.find(key);
+    if (entry == cache.end()) {
+      misses++;
+      return NULL;
+    }
+    hits++;
+    g_object_ref(entry->second);
+    return entry->second;
+  }
+
+  /*
+    Add a newly created object to a cache, which keeps its own reference, unless another thread did so first,
+    in which case the existing one is used instead. Caller must hold the mutex.
+  */
+  template <typename K, typename T>
+  static T* Add(std::map<K, T*> &cache, K const &key, T *object) {
+    auto entry = cache.find(key);
+    if (entry != cache.end()) {
+      g_object_unref(object);
+      object = entry->second;
+    } else {
+      cache[key] = object;
+    }
+    g_object_ref(object);
+    return object;
+  }
+
+  VipsInterpolate* GetInterpolator(std::string const &name) {
+    g_mutex_lock(&mutex);
+    VipsInterpolate *interpolator = Find(interpolators, name);
+    g_mutex_unlock(&mutex);
+    if (interpolator == NULL) {
+      interpolator = vips_interpolate_new(name.c_str());
+      if (interpolator != NULL) {
+        g_mutex_lock(&mutex);
+        interpolator = Add(interpolators, name, interpolator);
+        g_mutex_unlock(&mutex);
+      }
+    }
+    return interpolator;
+  }
+
+  VipsImage* GetGaussian(double const sigma, double const minAmplitude) {
+    std::pair<double, double> key = std::make_pair(sigma, minAmplitude);
+    g_mutex_lock(&mutex);
+    VipsImage *gaussian = Find(kernels, key);
+    g_mutex_unlock(&mutex);
+    if (gaussian == NULL) {
+      if (vips_gaussmat(&gaussian, sigma, minAmplitude, "separable", TRUE, "integer", TRUE, NULL)) {
+        return NULL;
+      }
+      g_mutex_lock(&mutex);
+      if (kernels.size() < maxKernels) {
+        gaussian = Add(kernels, key, gaussian);
+      }
+      g_mutex_unlock(&mutex);
+    }
+    return gaussian;
+  }
+
+  /*
+    Get a 3x3 convolution matrix, creating it with the given coefficients and scale on first use
+  */
+  static VipsImage* GetMatrix(std::string const &name, double const coefficients[9], double const scale) {
+    g_mutex_lock(&mutex);
+    VipsImage *matrix = Find(matrices, name);
+    if (matrix == NULL) {
+      matrix = vips_image_new_matrixv(3, 3,
+        coefficients[0], coefficients[1], coefficients[2],
+        coefficients[3], coefficients[4], coefficients[5],
+        coefficients[6], coefficients[7], coefficients[8]);
+      vips_image_set_double(matrix, "scale", scale);
+      matrix = Add(matrices, name, matrix);
+    }
+    g_mutex_unlock(&mutex);
+    return matrix;
+  }
+
+  VipsImage* GetMildBlur() {
+    // Averages neighbouring pixels
+    static double const coefficients[9] = {
+      1.0, 1.0, 1.0,
+      1.0, 1.0, 1.0,
+      1.0, 1.0, 1.0
+    };
+    return GetMatrix("blur", coefficients, 9);
+  }
+
+  VipsImage* GetMildSharpen() {
+    static double const coefficients[9] = {
+      -1.0, -1.0, -1.0,
+      -1.0, 32.0, -1.0,
+      -1.0, -1.0, -1.0
+    };
+    return GetMatrix("sharpen", coefficients, 24);
+  }
+
+  bool GetProfile(std::string const &path, std::string &profile) {
+    g_mutex_lock(&mutex);
+    auto entry = profiles.find(path);
+    bool found = entry != profiles.end();
+    if (found) {
+      hits++;
+      profile = entry->second;
+    } else {
+      misses++;
+    }
+    g_mutex_unlock(&mutex);
+    if (!found) {
+      gchar *contents;
+      gsize length;
+      if (!g_file_get_contents(path.c_str(), &contents, &length, NULL)) {
+        return FALSE;
+      }
+      profile.assign(contents, length);
+      g_free(contents);
+      g_mutex_lock(&mutex);
+      profiles[path] = profile;
+      g_mutex_unlock(&mutex);
+    }
+    return TRUE;
+  }
+
+  ResourceCounts GetResourceCounts() {
+    g_mutex_lock(&mutex);
+    ResourceCounts counts = { interpolators.size(), kernels.size(), matrices.size(), profiles.size(), hits, misses };
+    g_mutex_unlock(&mutex);
+    return counts;
+  }
+
+}  // namespace sharp
@@ -0,0 +1,54 @@
+#ifndef SRC_RESOURCES_H_
+#define SRC_RESOURCES_H_
+
+#include <cstddef>
+#include <string>
+
+#include <vips/vips.h>
+
+namespace sharp {
+
+  /*
+    Process-wide cache of immutable resources shared by all tasks, each created once on first use.
+    Getters return a new reference, which the caller must unref, or NULL on error.
+  */
+
+  /*
+    Get the named interpolator, e.g. "bilinear".
+  */
+  VipsInterpolate* GetInterpolator(std::string const &name);
+
+  /*
+    Get a separable, integer Gaussian kernel for a standard deviation and minimum amplitude.
+    Only a limited number of kernels are kept, beyond which new ones are created for each call.
+  */
+  VipsImage* GetGaussian(double const sigma, double const minAmplitude);
+
+  /*
+    Get the 3x3 convolution matrix for fast, mild blur or sharpen.
+  */
+  VipsImage* GetMildBlur();
+  VipsImage* GetMildSharpen();
+
+  /*
+    Get the content of an ICC profile file, read once. Returns false if it cannot be read.
+  */
+  bool GetProfile(std::string const &path, std::string &profile);
+
+  struct ResourceCounts {
+    size_t interpolators;
+    size_t kernels;
+    size_t matrices;
+    size_t profiles;
+    double hits;
+    double misses;
+  };
+
+  /*
+    Get the number of resources of each kind held, and how often lookups found them.
+  */
+  ResourceCounts GetResourceCounts();
+
+}  // namespace sharp
+
+#endif  // SRC_RESOURCES_H_
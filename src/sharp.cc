@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include "metadata.h"
+#include "metrics.h"
 #include "resize.h"
 #include "utilities.h"
 
@@ -22,10 +23,20 @@ extern "C" void init(v8::Handle<v8::Object> target) {
 
   // Methods available to JavaScript
   NODE_SET_METHOD(target, "metadata", metadata);
+  NODE_SET_METHOD(target, "metadataBatch", metadataBatch);
+  NODE_SET_METHOD(target, "sniff", sniff);
   NODE_SET_METHOD(target, "resize", resize);
+  NODE_SET_METHOD(target, "cancel", cancel);
+  NODE_SET_METHOD(target, "pipeline", pipeline);
+  NODE_SET_METHOD(target, "pipelineResize", pipelineResize);
+  NODE_SET_METHOD(target, "pipelineRelease", pipelineRelease);
   NODE_SET_METHOD(target, "cache", cache);
   NODE_SET_METHOD(target, "concurrency", concurrency);
+  NODE_SET_METHOD(target, "simd", simd);
+  NODE_SET_METHOD(target, "pool", pool);
+  NODE_SET_METHOD(target, "admission", admission);
   NODE_SET_METHOD(target, "counters", counters);
+  NODE_SET_METHOD(target, "metrics", metrics);
   NODE_SET_METHOD(target, "libvipsVersion", libvipsVersion);
   NODE_SET_METHOD(target, "format", format);
 }
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <vips/vips.h>
+
+#include "common.h"
+#include "smartcrop.h"
+
+namespace sharp {
+
+  // Cells along the longest side of the proxy grid on which windows are scored
+  static int const proxySize = 128;
+  // Luminance bins used to measure entropy
+  static int const bins = 16;
+
+  bool IsCropStrategy(int const gravity) {
+    return gravity == static_cast<int>(CropStrategy::ENTROPY) || gravity == static_cast<int>(CropStrategy::ATTENTION);
+  }
+
+  bool CanScoreCrop(VipsImage *image) {
+    int const colours = image->Bands - (HasAlpha(image) ? 1 : 0);
+    return image->BandFmt == VIPS_FORMAT_UCHAR && (colours == 1 || colours == 3);
+  }
+
+  /*
+    Sum of a rectangle of cells from an integral image with a stride of width + 1
+  */
+  template <typename T>
+  static T Sum(std::vector<T> const &integral, int const stride, int const left, int const top, int const width, int const height) {
+    return integral[(top + height) * stride + left + width] - integral[top * stride + left + width]
+      - integral[(top + height) * stride + left] + integral[top * stride + left];
+  }
+
+  /*
+    Integral image of per-cell values, with a leading row and column of zeros
+  */
+  template <typename T>
+  static std::vector<T> Integrate(std::vector<T> const &values, int const width, int const height) {
+    int const stride = width + 1;
+    std::vector<T> integral(stride * (height + 1), 0);
+    for (int y = 0; y < height; y++) {
+      T row = 0;
+      for (int x = 0; x < width; x++) {
+        row += values[y * width + x];
+        integral[(y + 1) * stride + x + 1] = integral[y * stride + x + 1] + row;
+      }
+    }
+    return integral;
+  }
+
+  /*
+    Is this average colour within a simple RGB model of skin tones?
+  */
+  static bool IsSkin(int const r, int const g, int const b) {
+    return r > 95 && g > 40 && b > 20 && r > g && r > b && r - std::min(g, b) > 15 && r - g > 15;
+  }
+
+  std::tuple<double, double> ChooseCrop(VipsImage *image, int const width, int const height, int const strategy) {
+    int const bands = image->Bands;
+    bool const rgb = bands - (HasAlpha(image) ? 1 : 0) == 3;
+    // Average the image into a proxy grid of square cells
+    int const cell = std::max(1, (std::max(image->Xsize, image->Ysize) + proxySize - 1) / proxySize);
+    int const gridWidth = (image->Xsize + cell - 1) / cell;
+    int const gridHeight = (image->Ysize + cell - 1) / cell;
+    int const cells = gridWidth * gridHeight;
+    std::vector<guint32> sums(cells * 3, 0);
+    std::vector<guint32> counts(cells, 0);
+    for (int y = 0; y < image->Ysize; y++) {
+      guchar const *p = VIPS_IMAGE_ADDR(image, 0, y);
+      guint32 *row = sums.data() + (y / cell) * gridWidth * 3;
+      guint32 *rowCounts = counts.data() + (y / cell) * gridWidth;
+      for (int x = 0; x < image->Xsize; x++, p += bands) {
+        guint32 *sum = row + (x / cell) * 3;
+        sum[0] += p[0];
+        sum[1] += rgb ? p[1] : p[0];
+        sum[2] += rgb ? p[2] : p[0];
+        rowCounts[x / cell]++;
+      }
+    }
+    std::vector<int> red(cells);
+    std::vector<int> green(cells);
+    std::vector<int> blue(cells);
+    std::vector<int> luminance(cells);
+    for (int i = 0; i < cells; i++) {
+      red[i] = sums[i * 3] / counts[i];
+      green[i] = sums[i * 3 + 1] / counts[i];
+      blue[i] = sums[i * 3 + 2] / counts[i];
+      luminance[i] = (77 * red[i] + 150 * green[i] + 29 * blue[i] + 128) >> 8;
+    }
+
+    // Window in cells
+    int const windowWidth = std::min(std::max(static_cast<int>(round(static_cast<double>(width) / cell)), 1), gridWidth);
+    int const windowHeight = std::min(std::max(static_cast<int>(round(static_cast<double>(height) / cell)), 1), gridHeight);
+    int const stride = gridWidth + 1;
+
+    // Per-cell scores, integrated for constant-time window sums
+    std::vector<guint32> histogram[bins];
+    std::vector<double> attention;
+    if (strategy == static_cast<int>(CropStrategy::ENTROPY)) {
+      // Count of cells in each luminance bin
+      for (int bin = 0; bin < bins; bin++) {
+        std::vector<guint32> inBin(cells);
+        for (int i = 0; i < cells; i++) {
+          inBin[i] = (luminance[i] * bins / 256 == bin) ? 1 : 0;
+        }
+        histogram[bin] = Integrate(inBin, gridWidth, gridHeight);
+      }
+    } else {
+      // Edges, saturated colour and skin tones attract attention
+      std::vector<double> score(cells);
+      for (int y = 0; y < gridHeight; y++) {
+        for (int x = 0; x < gridWidth; x++) {
+          int const i = y * gridWidth + x;
+          int const left = luminance[y * gridWidth + std::max(x - 1, 0)];
+          int const right = luminance[y * gridWidth + std::min(x + 1, gridWidth - 1)];
+          int const above = luminance[std::max(y - 1, 0) * gridWidth + x];
+          int const below = luminance[std::min(y + 1, gridHeight - 1) * gridWidth + x];
+          int const edge = std::abs(right - left) + std::abs(below - above);
+          int const saturation = std::max(red[i], std::max(green[i], blue[i])) - std::min(red[i], std::min(green[i], blue[i]));
+          score[i] = edge + saturation / 2.0 + (IsSkin(red[i], green[i], blue[i]) ? 64.0 : 0.0);
+        }
+      }
+      attention = Integrate(score, gridWidth, gridHeight);
+    }
+
+    // Score every window position, preferring the most central of equal scores
+    int bestLeft = (gridWidth - windowWidth) / 2;
+    int bestTop = (gridHeight - windowHeight) / 2;
+    double bestScore = -1.0;
+    double bestDistance = 0.0;
+    double const windowCells = static_cast<double>(windowWidth * windowHeight);
+    for (int top = 0; top <= gridHeight - windowHeight; top++) {
+      for (int left = 0; left <= gridWidth - windowWidth; left++) {
+        double score = 0.0;
+        if (strategy == static_cast<int>(CropStrategy::ENTROPY)) {
+          // Shannon entropy of the luminance histogram of the window
+          for (int bin = 0; bin < bins; bin++) {
+            guint32 const count = Sum(histogram[bin], stride, left, top, windowWidth, windowHeight);
+            if (count > 0) {
+              double const probability = count / windowCells;
+              score -= probability * log2(probability);
+            }
+          }
+        } else {
+          score = Sum(attention, stride, left, top, windowWidth, windowHeight);
+        }
+        double const distance = std::abs(2 * left + windowWidth - gridWidth) + std::abs(2 * top + windowHeight - gridHeight);
+        if (score > bestScore + 1e-9 || (score > bestScore - 1e-9 && distance < bestDistance)) {
+          bestLeft = left;
+          bestTop = top;
+          bestScore = score;
+          bestDistance = distance;
+        }
+      }
+    }
+    double const x = std::min((bestLeft + windowWidth / 2.0) * cell / image->Xsize, 1.0);
+    double const y = std::min((bestTop + windowHeight / 2.0) * cell / image->Ysize, 1.0);
+    return std::make_tuple(x, y);
+  }
+
+  std::tuple<int, int> CalculateCropAround(int const inWidth, int const inHeight, int const outWidth, int const outHeight,
+    double const x, double const y) {
+    int const left = static_cast<int>(round(x * inWidth - outWidth / 2.0));
+    int const top = static_cast<int>(round(y * inHeight - outHeight / 2.0));
+    return std::make_tuple(
+      std::min(std::max(left, 0), std::max(inWidth - outWidth, 0)),
+      std::min(std::max(top, 0), std::max(inHeight - outHeight, 0))
+    );
+  }
+
+}  // namespace sharp
@@ -0,0 +1,43 @@
+#ifndef SRC_SMARTCROP_H_
+#define SRC_SMARTCROP_H_
+
+#include <tuple>
+
+#include <vips/vips.h>
+
+namespace sharp {
+
+  /*
+    Crop strategies, passed as gravity values beyond those of the fixed positions
+  */
+  enum class CropStrategy {
+    ENTROPY = 16,
+    ATTENTION = 17
+  };
+
+  /*
+    Does this gravity choose the crop from the content of the image?
+  */
+  bool IsCropStrategy(int const gravity);
+
+  /*
+    Can the content of this image be scored? Requires 8-bit greyscale or RGB, with optional alpha, held in memory.
+  */
+  bool CanScoreCrop(VipsImage *image);
+
+  /*
+    Choose the centre of the crop window of the given size that scores highest with the strategy.
+    Returns the centre as fractions of the width and height of the image.
+  */
+  std::tuple<double, double> ChooseCrop(VipsImage *image, int const width, int const height, int const strategy);
+
+  /*
+    Calculate the (left, top) coordinates of the output image within the input image,
+    centred as near as possible on the given fractions of its width and height.
+  */
+  std::tuple<int, int> CalculateCropAround(int const inWidth, int const inHeight, int const outWidth, int const outHeight,
+    double const x, double const y);
+
+}  // namespace sharp
+
+#endif  // SRC_SMARTCROP_H_
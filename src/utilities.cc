@@ -4,6 +4,11 @@
 #include "nan.h"
 
 #include "common.h"
+#include "convolve.h"
+#include "intermediates.h"
+#include "outputcache.h"
+#include "pool.h"
+#include "resources.h"
 #include "utilities.h"
 
 using v8::Local;
@@ -14,9 +19,29 @@ using v8::Boolean;
 
 using sharp::counterQueue;
 using sharp::counterProcess;
+using sharp::counterRejected;
+using sharp::IntermediatesStats;
+using sharp::GetIntermediatesStats;
+using sharp::SetIntermediatesMemory;
+using sharp::OutputCacheStats;
+using sharp::GetOutputCacheStats;
+using sharp::SetOutputCacheMemory;
+using sharp::ConvolveInstructions;
+using sharp::SetConvolveEnabled;
+using sharp::ResourceCounts;
+using sharp::GetResourceCounts;
+using sharp::PoolThreads;
+using sharp::SetPoolThreads;
+using sharp::ShortestJobFirst;
+using sharp::SetShortestJobFirst;
+using sharp::MemoryAdmitted;
+using sharp::MemoryBudget;
+using sharp::QueueDepth;
+using sharp::SetAdmission;
 
 /*
-  Get and set cache memory and item limits
+  Get and set cache memory and item limits, and the memory limits of the intermediate and output image caches.
+  Also reports the shared resources, such as interpolators and convolution kernels, held for reuse by all tasks.
 */
 NAN_METHOD(cache) {
   NanScope();
@@ -36,12 +61,47 @@ NAN_METHOD(cache) {
     vips_cache_set_max(args[1]->Int32Value());
   }
 
+  // Set intermediate image cache memory limit
+  if (args[2]->IsInt32() && args[2]->Int32Value() >= 0) {
+    SetIntermediatesMemory(static_cast<size_t>(args[2]->Int32Value()) * 1048576);
+  }
+
+  // Set output image cache memory limit
+  if (args[3]->IsInt32() && args[3]->Int32Value() >= 0) {
+    SetOutputCacheMemory(static_cast<size_t>(args[3]->Int32Value()) * 1048576);
+  }
+
   // Get cache statistics
   Local<Object> cache = NanNew<Object>();
   cache->Set(NanNew<String>("current"), NanNew<Number>(vips_tracked_get_mem() / 1048576));
   cache->Set(NanNew<String>("high"), NanNew<Number>(vips_tracked_get_mem_highwater() / 1048576));
   cache->Set(NanNew<String>("memory"), NanNew<Number>(vips_cache_get_max_mem() / 1048576));
   cache->Set(NanNew<String>("items"), NanNew<Number>(vips_cache_get_max()));
+  IntermediatesStats stats = GetIntermediatesStats();
+  Local<Object> intermediates = NanNew<Object>();
+  intermediates->Set(NanNew<String>("current"), NanNew<Number>(stats.current / 1048576));
+  intermediates->Set(NanNew<String>("memory"), NanNew<Number>(stats.memory / 1048576));
+  intermediates->Set(NanNew<String>("items"), NanNew<Number>(stats.items));
+  intermediates->Set(NanNew<String>("hits"), NanNew<Number>(static_cast<double>(stats.hits)));
+  intermediates->Set(NanNew<String>("misses"), NanNew<Number>(static_cast<double>(stats.misses)));
+  cache->Set(NanNew<String>("intermediates"), intermediates);
+  OutputCacheStats outputStats = GetOutputCacheStats();
+  Local<Object> outputs = NanNew<Object>();
+  outputs->Set(NanNew<String>("current"), NanNew<Number>(outputStats.current / 1048576));
+  outputs->Set(NanNew<String>("memory"), NanNew<Number>(outputStats.memory / 1048576));
+  outputs->Set(NanNew<String>("items"), NanNew<Number>(outputStats.items));
+  outputs->Set(NanNew<String>("hits"), NanNew<Number>(outputStats.hits));
+  outputs->Set(NanNew<String>("misses"), NanNew<Number>(outputStats.misses));
+  cache->Set(NanNew<String>("outputs"), outputs);
+  ResourceCounts resourceCounts = GetResourceCounts();
+  Local<Object> resources = NanNew<Object>();
+  resources->Set(NanNew<String>("interpolators"), NanNew<Number>(resourceCounts.interpolators));
+  resources->Set(NanNew<String>("kernels"), NanNew<Number>(resourceCounts.kernels));
+  resources->Set(NanNew<String>("matrices"), NanNew<Number>(resourceCounts.matrices));
+  resources->Set(NanNew<String>("profiles"), NanNew<Number>(resourceCounts.profiles));
+  resources->Set(NanNew<String>("hits"), NanNew<Number>(resourceCounts.hits));
+  resources->Set(NanNew<String>("misses"), NanNew<Number>(resourceCounts.misses));
+  cache->Set(NanNew<String>("resources"), resources);
   NanReturnValue(cache);
 }
 
@@ -60,13 +120,70 @@ NAN_METHOD(concurrency) {
 }
 
 /*
-  Get internal counters (queued tasks, processing tasks)
+  Enable or disable SIMD convolution for mild blur, mild sharpen and Gaussian kernels, returning the instruction set in use
+*/
+NAN_METHOD(simd) {
+  NanScope();
+
+  if (args[0]->IsBoolean()) {
+    SetConvolveEnabled(args[0]->BooleanValue());
+  }
+  NanReturnValue(NanNew<String>(ConvolveInstructions().c_str()));
+}
+
+/*
+  Get and set size of native worker pool, and whether it orders tasks shortest job first
+*/
+NAN_METHOD(pool) {
+  NanScope();
+
+  // Set number of threads
+  if (args[0]->IsInt32() && args[0]->Int32Value() > 0) {
+    SetPoolThreads(args[0]->Int32Value());
+  }
+  // Set ordering
+  if (args[1]->IsBoolean()) {
+    SetShortestJobFirst(args[1]->BooleanValue());
+  }
+  // Get pool settings
+  Local<Object> pool = NanNew<Object>();
+  pool->Set(NanNew<String>("threads"), NanNew<Number>(PoolThreads()));
+  pool->Set(NanNew<String>("shortestJobFirst"), NanNew<Boolean>(ShortestJobFirst()));
+  NanReturnValue(pool);
+}
+
+/*
+  Get and set admission control limits: memory budget (MB) of processing tasks and maximum queue length
+*/
+NAN_METHOD(admission) {
+  NanScope();
+
+  size_t memory = MemoryBudget();
+  size_t queue = QueueDepth();
+  if (args[0]->IsInt32() && args[0]->Int32Value() >= 0) {
+    memory = static_cast<size_t>(args[0]->Int32Value()) * 1048576;
+  }
+  if (args[1]->IsInt32() && args[1]->Int32Value() >= 0) {
+    queue = static_cast<size_t>(args[1]->Int32Value());
+  }
+  SetAdmission(memory, queue);
+  // Get admission control limits
+  Local<Object> admission = NanNew<Object>();
+  admission->Set(NanNew<String>("memory"), NanNew<Number>(MemoryBudget() / 1048576));
+  admission->Set(NanNew<String>("queue"), NanNew<Number>(QueueDepth()));
+  NanReturnValue(admission);
+}
+
+/*
+  Get internal counters (queued tasks, processing tasks, estimated memory (MB) of processing tasks, rejected tasks)
 */
 NAN_METHOD(counters) {
   NanScope();
   Local<Object> counters = NanNew<Object>();
   counters->Set(NanNew<String>("queue"), NanNew<Number>(counterQueue));
   counters->Set(NanNew<String>("process"), NanNew<Number>(counterProcess));
+  counters->Set(NanNew<String>("memory"), NanNew<Number>(MemoryAdmitted() / 1048576.0));
+  counters->Set(NanNew<String>("rejected"), NanNew<Number>(counterRejected));
   NanReturnValue(counters);
 }
 
@@ -121,6 +238,13 @@ NAN_METHOD(format) {
     format->Set(formatId, container);
   }
 
+  // Deep Zoom output to a Buffer or Stream, in a zip container, is written via a temporary file before libvips 8.9.0
+  if (vips_version(0) >= 8 && vips_type_find("VipsOperation", "dzsave")) {
+    Local<Object> dzOutput = format->Get(NanNew<String>("dz"))->ToObject()->Get(attrOutput)->ToObject();
+    dzOutput->Set(attrBuffer, NanNew<Boolean>(true));
+    dzOutput->Set(attrStream, NanNew<Boolean>(true));
+  }
+
   // Raw, uncompressed data
   Local<Object> raw = NanNew<Object>();
   raw->Set(attrId, NanNew<String>("raw"));
@@ -5,6 +5,9 @@
 
 NAN_METHOD(cache);
 NAN_METHOD(concurrency);
+NAN_METHOD(simd);
+NAN_METHOD(pool);
+NAN_METHOD(admission);
 NAN_METHOD(counters);
 NAN_METHOD(libvipsVersion);
 NAN_METHOD(format);
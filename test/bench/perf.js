@@ -239,6 +239,33 @@ async.series({
           }
         });
       }
+    }).add('sharp-blur-sharpen-mild-simd', {
+      defer: true,
+      fn: function(deferred) {
+        sharp.simd(true);
+        sharp(inputJpgBuffer).resize(width, height).blur().sharpen().toBuffer(function(err, buffer) {
+          if (err) {
+            throw err;
+          } else {
+            assert.notStrictEqual(null, buffer);
+            deferred.resolve();
+          }
+        });
+      }
+    }).add('sharp-blur-sharpen-mild-libvips', {
+      defer: true,
+      fn: function(deferred) {
+        sharp.simd(false);
+        sharp(inputJpgBuffer).resize(width, height).blur().sharpen().toBuffer(function(err, buffer) {
+          sharp.simd(true);
+          if (err) {
+            throw err;
+          } else {
+            assert.notStrictEqual(null, buffer);
+            deferred.resolve();
+          }
+        });
+      }
     }).add('sharp-nearest-neighbour', {
       defer: true,
       fn: function(deferred) {
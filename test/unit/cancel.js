@@ -0,0 +1,151 @@
+'use strict';
+
+var assert = require('assert');
+
+var sharp = require('../../index');
+var fixtures = require('../fixtures');
+
+sharp.cache(0);
+
+// Call back once a task is being processed, rather than waiting in the queue
+var whenRunning = function(callback) {
+  if (sharp.counters().process === 1) {
+    callback();
+  } else {
+    setTimeout(whenRunning, 1, callback);
+  }
+};
+
+describe('Timeout and cancellation', function() {
+
+  it('Times out while running', function(done) {
+    var running = false;
+    // A large render that starts at once but takes far longer than its timeout
+    sharp(fixtures.inputJpg).resize(8000, 6000).blur(20).timeout(500).toBuffer(function(err, data) {
+      assert.strictEqual(true, running);
+      assert.strictEqual(true, err instanceof Error);
+      assert.strictEqual('ETIMEDOUT', err.code);
+      assert.strictEqual(null, data);
+      done();
+    });
+    whenRunning(function() {
+      running = true;
+    });
+  });
+
+  it('Times out while queued', function(done) {
+    var defaultPool = sharp.pool();
+    sharp.pool(1);
+    var running = sharp(fixtures.inputJpg).resize(4000, 3000).blur(10);
+    running.toBuffer(function(err) {
+      assert.strictEqual('ECANCELED', err.code);
+    });
+    whenRunning(function() {
+      sharp(fixtures.inputJpg).resize(320, 240).timeout(1).toBuffer(function(err, data) {
+        assert.strictEqual(true, err instanceof Error);
+        assert.strictEqual('ETIMEDOUT', err.code);
+        assert.strictEqual(null, data);
+        sharp.pool(defaultPool.threads);
+        done();
+      });
+      // Free the only thread once the queued task has passed its deadline
+      setTimeout(function() {
+        running.cancel();
+      }, 10);
+    });
+  });
+
+  it('Completes within timeout', function(done) {
+    sharp(fixtures.inputJpg).resize(320, 240).timeout(60000).toBuffer(function(err, data, info) {
+      if (err) throw err;
+      assert.strictEqual(true, data.length > 0);
+      assert.strictEqual(320, info.width);
+      assert.strictEqual(240, info.height);
+      done();
+    });
+  });
+
+  it('Cancels while running', function(done) {
+    var transformer = sharp(fixtures.inputJpg).resize(8000, 6000).blur(20);
+    transformer.toBuffer(function(err, data) {
+      assert.strictEqual(true, err instanceof Error);
+      assert.strictEqual('ECANCELED', err.code);
+      assert.strictEqual(null, data);
+      done();
+    });
+    whenRunning(function() {
+      transformer.cancel();
+    });
+  });
+
+  it('Cancels a pipeline task while running', function(done) {
+    var pipeline = sharp.pipeline({ resize: [8000, 6000], blur: 20 });
+    pipeline.toBuffer(fixtures.inputJpg, function(err) {
+      assert.strictEqual(true, err instanceof Error);
+      assert.strictEqual('ECANCELED', err.code);
+      pipeline.release();
+      done();
+    });
+    whenRunning(function() {
+      pipeline.cancel();
+    });
+  });
+
+  it('Drops cancelled task while queued', function(done) {
+    var defaultPool = sharp.pool();
+    sharp.pool(1);
+    var running = sharp(fixtures.inputJpg).resize(320, 240);
+    var queued = sharp(fixtures.inputJpg).resize(320, 240);
+    running.toBuffer(function(err) {
+      if (err) throw err;
+    });
+    queued.toBuffer(function(err) {
+      assert.strictEqual(true, err instanceof Error);
+      assert.strictEqual('ECANCELED', err.code);
+      sharp.pool(defaultPool.threads);
+      done();
+    });
+    queued.cancel();
+  });
+
+  it('Cancelling a task leaves its cached intermediate usable', function(done) {
+    sharp.cache(null, null, 64);
+    var hits = sharp.cache().intermediates.hits;
+    var renditions = [{ width: 2000 }, { width: 1000 }];
+    sharp(fixtures.inputJpg).toBuffers(renditions, function(err) {
+      if (err) throw err;
+      // Renditions render the shared, cached intermediate itself
+      var cancelled = sharp(fixtures.inputJpg);
+      cancelled.toBuffers(renditions, function(err) {
+        if (err) {
+          assert.strictEqual('ECANCELED', err.code);
+        }
+        sharp(fixtures.inputJpg).toBuffers(renditions, function(err, outputs) {
+          if (err) throw err;
+          assert.strictEqual(2000, outputs[0].info.width);
+          assert.strictEqual(1000, outputs[1].info.width);
+          assert.strictEqual(hits + 2, sharp.cache().intermediates.hits);
+          sharp.cache(null, null, 0);
+          done();
+        });
+      });
+      whenRunning(function() {
+        cancelled.cancel();
+      });
+    });
+  });
+
+  it('Cancel before start is harmless', function() {
+    sharp(fixtures.inputJpg).cancel();
+  });
+
+  it('Invalid timeout', function() {
+    assert.throws(function() {
+      sharp().timeout(-1);
+    });
+    assert.throws(function() {
+      sharp().timeout(1.5);
+    });
+  });
+
+});
@@ -1,5 +1,6 @@
 'use strict';
 
+var fs = require('fs');
 var assert = require('assert');
 
 var sharp = require('../../index');
@@ -7,6 +8,42 @@ var fixtures = require('../fixtures');
 
 sharp.cache(0);
 
+// Copy of a JPEG image without its APP2 ICC_PROFILE segments, leaving its pixels unchanged
+var withoutProfile = function(jpeg) {
+  var segments = [jpeg.slice(0, 2)];
+  var offset = 2;
+  while (offset < jpeg.length && jpeg[offset] === 0xFF && jpeg[offset + 1] !== 0xDA) {
+    var end = offset + 2 + jpeg.readUInt16BE(offset + 2);
+    if (jpeg[offset + 1] !== 0xE2 || jpeg.toString('ascii', offset + 4, offset + 15) !== 'ICC_PROFILE') {
+      segments.push(jpeg.slice(offset, end));
+    }
+    offset = end;
+  }
+  segments.push(jpeg.slice(offset));
+  return Buffer.concat(segments);
+};
+
+// Raw pixels of an image, resized to 320 pixels wide, and of the same image without its profile
+var withAndWithoutProfile = function(input, callback) {
+  var jpeg = fs.readFileSync(input);
+  sharp(jpeg).metadata(function(err, metadata) {
+    if (err) throw err;
+    assert.strictEqual(true, metadata.hasProfile);
+    sharp(jpeg).resize(320).raw().toBuffer(function(err, converted) {
+      if (err) throw err;
+      var stripped = withoutProfile(jpeg);
+      sharp(stripped).metadata(function(err, metadata) {
+        if (err) throw err;
+        assert.strictEqual(false, metadata.hasProfile);
+        sharp(stripped).resize(320).raw().toBuffer(function(err, unconverted) {
+          if (err) throw err;
+          callback(jpeg, converted, unconverted);
+        });
+      });
+    });
+  });
+};
+
 describe('Colour space conversion', function() {
 
   it('To greyscale', function(done) {
@@ -70,6 +107,25 @@ describe('Colour space conversion', function() {
       });
   });
 
+  it('From embedded sRGB profile, an identity', function(done) {
+    withAndWithoutProfile(fixtures.inputJpgWithLowContrast, function(jpeg, converted, unconverted) {
+      assert.notStrictEqual(-1, jpeg.toString('binary').indexOf('sRGB IEC61966-2.1'));
+      // The transform was skipped, leaving pixels as decoded
+      assert.strictEqual(unconverted.toString('hex'), converted.toString('hex'));
+      done();
+    });
+  });
+
+  it('From embedded non-sRGB RGB profile to sRGB', function(done) {
+    withAndWithoutProfile(fixtures.inputJpgWithExif, function(jpeg, converted, unconverted) {
+      assert.notStrictEqual(-1, jpeg.toString('binary').indexOf('Generic RGB Profile'));
+      // The transform was applied
+      assert.strictEqual(unconverted.length, converted.length);
+      assert.notStrictEqual(unconverted.toString('hex'), converted.toString('hex'));
+      done();
+    });
+  });
+
   it('From profile-less CMYK to sRGB', function(done) {
     sharp(fixtures.inputJpgWithCmykNoProfile)
       .resize(320)
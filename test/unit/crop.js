@@ -7,6 +7,27 @@ var fixtures = require('../fixtures');
 
 sharp.cache(0);
 
+/*
+  PNG image of the given dimensions whose detail lies only after a flat black region, to the right when wide
+  or below when tall, so a content-aware crop chooses a different region to a centred crop
+*/
+var offCentre = function(width, height, callback) {
+  var wide = width > height;
+  // Embedding in a canvas twice as long centres the detail between flat borders
+  sharp(fixtures.inputJpg)
+    .resize(wide ? width * 2 : width, wide ? height : height * 2)
+    .embed()
+    .png()
+    .toBuffer(function(err, embedded) {
+      if (err) throw err;
+      // Drop the trailing border, leaving the detail at the end
+      sharp(embedded).extract(0, 0, width, height).png().toBuffer(function(err, data) {
+        if (err) throw err;
+        callback(data);
+      });
+    });
+};
+
 describe('Crop gravities', function() {
 
   it('North', function(done) {
@@ -81,6 +102,59 @@ describe('Crop gravities', function() {
       });
   });
 
+  it('Entropy strategy', function(done) {
+    offCentre(500, 150, function(input) {
+      sharp(input)
+        .resize(150, 150)
+        .crop(sharp.strategy.entropy)
+        .toFile(fixtures.path('output.strategy-entropy.jpg'), function(err, info) {
+          if (err) throw err;
+          assert.strictEqual(150, info.width);
+          assert.strictEqual(150, info.height);
+          assert.strictEqual(0, info.cropOffsetTop);
+          // Towards the detail on the right, rather than the centre
+          assert.strictEqual(true, info.cropOffsetLeft > (500 - 150) / 2);
+          done();
+        });
+    });
+  });
+
+  it('Attention strategy', function(done) {
+    offCentre(150, 500, function(input) {
+      sharp(input)
+        .resize(150, 150)
+        .crop(sharp.strategy.attention)
+        .toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(150, info.width);
+          assert.strictEqual(150, info.height);
+          assert.strictEqual(0, info.cropOffsetLeft);
+          // Towards the detail below, rather than the centre
+          assert.strictEqual(true, info.cropOffsetTop > (500 - 150) / 2);
+          // The same region can be extracted from the resized image
+          sharp(input)
+            .extract(info.cropOffsetTop, info.cropOffsetLeft, 150, 150)
+            .toBuffer(function(err, extracted, extractedInfo) {
+              if (err) throw err;
+              assert.strictEqual(150, extractedInfo.width);
+              assert.strictEqual(150, extractedInfo.height);
+              done();
+            });
+        });
+    });
+  });
+
+  it('Fixed gravity does not report offsets', function(done) {
+    sharp(fixtures.inputJpg)
+      .resize(320, 80)
+      .crop(sharp.gravity.north)
+      .toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(undefined, info.cropOffsetLeft);
+        done();
+      });
+  });
+
   it('Invalid', function(done) {
     var isValid = true;
     try {
@@ -10,6 +10,31 @@ var fixtures = require('../fixtures');
 
 sharp.cache(0);
 
+// Tags of each image file directory of a classic TIFF file, by tag number, for values held in the entry itself
+var tiffDirectories = function(data) {
+  var littleEndian = data.toString('ascii', 0, 2) === 'II';
+  var uint16 = function(offset) {
+    return littleEndian ? data.readUInt16LE(offset) : data.readUInt16BE(offset);
+  };
+  var uint32 = function(offset) {
+    return littleEndian ? data.readUInt32LE(offset) : data.readUInt32BE(offset);
+  };
+  var directories = [];
+  var offset = uint32(4);
+  while (offset !== 0) {
+    var tags = {};
+    var count = uint16(offset);
+    for (var i = 0; i < count; i++) {
+      var entry = offset + 2 + i * 12;
+      // SHORT or LONG
+      tags[uint16(entry)] = uint16(entry + 2) === 3 ? uint16(entry + 8) : uint32(entry + 8);
+    }
+    directories.push(tags);
+    offset = uint32(offset + 2 + count * 12);
+  }
+  return directories;
+};
+
 describe('Input/output', function() {
 
   it('Read from File and write to Stream', function(done) {
@@ -47,6 +72,42 @@ describe('Input/output', function() {
     sharp(inputJpgBuffer).resize(320, 240).pipe(writable);
   });
 
+  if (process.platform !== 'win32') {
+    it('Write to Stream incrementally', function(done) {
+      var chunks = 0;
+      var length = 0;
+      sharp(fixtures.inputJpg).resize(2560).jpeg()
+        .on('data', function(chunk) {
+          chunks++;
+          length = length + chunk.length;
+        })
+        .on('end', function() {
+          assert.strictEqual(true, chunks > 1);
+          assert.strictEqual(true, length > 0);
+          done();
+        });
+    });
+
+    it('Write to Stream no faster than it is consumed', function(done) {
+      var transformer = sharp(fixtures.inputJpg).resize(2560).png();
+      // Start processing without consuming any output
+      transformer.read(0);
+      setTimeout(function() {
+        // Only a bounded amount of the multi-megabyte output is held while waiting for the consumer
+        assert.strictEqual(true, transformer._readableState.length < 262144);
+        var length = 0;
+        transformer
+          .on('data', function(chunk) {
+            length = length + chunk.length;
+          })
+          .on('end', function() {
+            assert.strictEqual(true, length > 1048576);
+            done();
+          });
+      }, 1000);
+    });
+  }
+
   it('Read from Stream and write to File', function(done) {
     var readable = fs.createReadStream(fixtures.inputJpg);
     var pipeline = sharp().resize(320, 240).toFile(fixtures.outputJpg, function(err, info) {
@@ -121,6 +182,17 @@ describe('Input/output', function() {
     readableButNotAnImage.pipe(pipeline).pipe(writable);
   });
 
+  it('Reject Stream input exceeding pixel limit before it finishes', function(done) {
+    var readable = fs.createReadStream(fixtures.inputJpg);
+    var pipeline = sharp().limitInputPixels(1).resize(320, 240).toBuffer(function(err) {
+      assert(!!err);
+      assert.strictEqual('Input image exceeds pixel limit', err.message);
+      assert.strictEqual(true, pipeline.options.bufferInLength < fs.statSync(fixtures.inputJpg).size);
+      done();
+    });
+    readable.pipe(pipeline);
+  });
+
   it('Handle File to Stream error', function(done) {
     var readableButNotAnImage = sharp(__filename).resize(320, 240);
     var anErrorWasEmitted = false;
@@ -167,6 +239,71 @@ describe('Input/output', function() {
       });
   });
 
+  it('Read from Buffer in place, kept alive while queued', function(done) {
+    var inputJpgBuffer = fs.readFileSync(fixtures.inputJpg);
+    sharp(inputJpgBuffer).resize(320, 240).toBuffer(function(err, data, info) {
+      if (err) throw err;
+      assert.strictEqual(true, data.length > 0);
+      assert.strictEqual(320, info.width);
+      assert.strictEqual(240, info.height);
+      done();
+    });
+    // Without the task's own reference, collection would free the Buffer it reads (run with node --expose-gc)
+    inputJpgBuffer = null;
+    if (typeof global.gc === 'function') {
+      global.gc();
+    }
+  });
+
+  describe('Modification of input Buffer while queued', function() {
+    var defaultPool;
+    var blocker;
+
+    // Occupy the only worker thread with a long-running task, so the next task stays queued
+    beforeEach(function(done) {
+      defaultPool = sharp.pool();
+      sharp.pool(1);
+      blocker = sharp(fixtures.inputJpg).resize(4000, 3000).blur(10).toBuffer();
+      var waitUntilRunning = function() {
+        if (sharp.counters().process === 1) {
+          done();
+        } else {
+          setTimeout(waitUntilRunning, 1);
+        }
+      };
+      waitUntilRunning();
+    });
+
+    afterEach(function(done) {
+      blocker.then(function() {
+        sharp.pool(defaultPool.threads);
+        done();
+      });
+    });
+
+    it('Observed when read in place', function(done) {
+      var inputJpgBuffer = fs.readFileSync(fixtures.inputJpg);
+      sharp(inputJpgBuffer).resize(320, 240).toBuffer(function(err) {
+        assert.strictEqual(true, err instanceof Error);
+        done();
+      });
+      inputJpgBuffer.fill(0);
+    });
+
+    it('Not observed when read from a copy', function(done) {
+      var inputJpgBuffer = fs.readFileSync(fixtures.inputJpg);
+      sharp(inputJpgBuffer).copyInput().resize(320, 240).toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(true, data.length > 0);
+        assert.strictEqual(320, info.width);
+        assert.strictEqual(240, info.height);
+        done();
+      });
+      inputJpgBuffer.fill(0);
+    });
+
+  });
+
   it('Fail when output File is input File', function(done) {
     sharp(fixtures.inputJpg).toFile(fixtures.inputJpg, function(err) {
       assert(!!err);
@@ -422,6 +559,73 @@ describe('Input/output', function() {
       });
     });
 
+    it('TIFF tiled pyramid with deflate compression', function(done) {
+      var output = fixtures.path('output.pyramid.tiff');
+      sharp(fixtures.inputJpg)
+        .resize(320, 240)
+        .tiff({ tileSize: 64, pyramid: true, compression: 'deflate', predictor: 'horizontal' })
+        .toFile(output, function(err, info) {
+          if (err) throw err;
+          assert.strictEqual('tiff', info.format);
+          assert.strictEqual(320, info.width);
+          assert.strictEqual(240, info.height);
+          sharp(output).metadata(function(err, metadata) {
+            if (err) throw err;
+            assert.strictEqual('tiff', metadata.format);
+            assert.strictEqual(320, metadata.width);
+            assert.strictEqual(240, metadata.height);
+            // Tiled, deflated and predicted at full resolution then each reduced resolution level
+            var directories = tiffDirectories(fs.readFileSync(output));
+            assert.strictEqual(true, directories.length > 1);
+            directories.forEach(function(tags, level) {
+              assert.strictEqual(64, tags[322]); // TileWidth
+              assert.strictEqual(64, tags[323]); // TileLength
+              assert.strictEqual(8, tags[259]); // Compression, Adobe deflate
+              assert.strictEqual(2, tags[317]); // Predictor, horizontal differencing
+              if (level === 0) {
+                assert.strictEqual(320, tags[256]);
+                assert.strictEqual(240, tags[257]);
+              } else {
+                assert.strictEqual(true, tags[256] < directories[level - 1][256]);
+                assert.strictEqual(true, tags[257] < directories[level - 1][257]);
+              }
+            });
+            fs.unlinkSync(output);
+            done();
+          });
+        });
+    });
+
+    it('TIFF pyramid shrinks on load from a reduced resolution level', function(done) {
+      var pyramid = fixtures.path('output.shrink.tiff');
+      sharp(fixtures.inputJpg).tiff({ pyramid: true }).toFile(pyramid, function(err) {
+        if (err) throw err;
+        sharp(pyramid).resize(320, 240).timings().jpeg().toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(320, info.width);
+          assert.strictEqual(240, info.height);
+          assert.strictEqual(true, info.timings.shrinkOnLoad > 1);
+          fs.unlinkSync(pyramid);
+          done();
+        });
+      });
+    });
+
+    it('TIFF invalid options', function() {
+      assert.throws(function() {
+        sharp().tiff({ tile: 'yes' });
+      });
+      assert.throws(function() {
+        sharp().tiff({ tileSize: 100 });
+      });
+      assert.throws(function() {
+        sharp().tiff({ compression: 'zoinks' });
+      });
+      assert.throws(function() {
+        sharp().tiff({ predictor: 'zoinks' });
+      });
+    });
+
     it('Fail with GIF', function(done) {
       sharp(fixtures.inputGif).resize(320, 80).toFile(fixtures.outputZoinks, function(err) {
         assert(!!err);
@@ -656,6 +860,31 @@ describe('Input/output', function() {
     });
   }
 
+  if (sharp.format.tiff.output.buffer) {
+    it('Save tiled TIFF to Buffer', function(done) {
+      sharp(fixtures.inputJpg)
+        .resize(320, 240)
+        .tiff({ tile: true, compression: 'lzw' })
+        .toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(data.length, info.size);
+          assert.strictEqual('tiff', info.format);
+          assert.strictEqual(320, info.width);
+          assert.strictEqual(240, info.height);
+          done();
+        });
+    });
+  } else {
+    it('Save TIFF to Buffer fails before processing', function(done) {
+      sharp(fixtures.inputJpg).resize(320, 240).tiff().toBuffer(function(err, data) {
+        assert.strictEqual(true, err instanceof Error);
+        assert.notStrictEqual(-1, err.message.indexOf('8.5.0'));
+        assert.strictEqual(undefined, data);
+        done();
+      });
+    });
+  }
+
   if (sharp.format.magick.input.buffer) {
     it('Load GIF from Buffer', function(done) {
       var inputGifBuffer = fs.readFileSync(fixtures.inputGif);
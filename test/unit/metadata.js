@@ -50,10 +50,31 @@ describe('Image metadata', function() {
       assert.strictEqual(1, metadata.channels);
       assert.strictEqual(false, metadata.hasProfile);
       assert.strictEqual(false, metadata.hasAlpha);
+      assert.strictEqual(undefined, metadata.levels);
       done();
     });
   });
 
+  it('Pyramidal TIFF reports resolution levels', function(done) {
+    var pyramid = fixtures.path('output.levels.tiff');
+    sharp(fixtures.inputJpg).tiff({ pyramid: true }).toFile(pyramid, function(err) {
+      if (err) throw err;
+      sharp(pyramid).metadata(function(err, metadata) {
+        if (err) throw err;
+        assert.strictEqual('tiff', metadata.format);
+        assert.strictEqual(true, Array.isArray(metadata.levels));
+        assert.strictEqual(true, metadata.levels.length > 1);
+        assert.strictEqual(2725, metadata.levels[0].width);
+        assert.strictEqual(2225, metadata.levels[0].height);
+        metadata.levels.slice(1).forEach(function(level, i) {
+          assert.strictEqual(true, level.width < metadata.levels[i].width);
+          assert.strictEqual(true, level.height < metadata.levels[i].height);
+        });
+        done();
+      });
+    });
+  });
+
   it('PNG', function(done) {
     sharp(fixtures.inputPng).metadata(function(err, metadata) {
       if (err) throw err;
@@ -234,6 +255,71 @@ describe('Image metadata', function() {
       });
   });
 
+  it('Header read from File and Buffer match', function(done) {
+    var inputs = [
+      fixtures.inputJpgWithExif,
+      fixtures.inputJpgWithCmykProfile,
+      fixtures.inputPngWithGreyAlpha,
+      fixtures.inputTiff
+    ];
+    var remaining = inputs.length;
+    inputs.forEach(function(input) {
+      sharp(input).metadata(function(err, fileMetadata) {
+        if (err) throw err;
+        sharp(fs.readFileSync(input)).metadata(function(err, bufferMetadata) {
+          if (err) throw err;
+          assert.deepEqual(fileMetadata, bufferMetadata);
+          remaining--;
+          if (remaining === 0) {
+            done();
+          }
+        });
+      });
+    });
+  });
+
+  it('Batch of File and Buffer inputs', function(done) {
+    sharp.metadataBatch([
+      fixtures.inputJpg,
+      fs.readFileSync(fixtures.inputPngWithTransparency),
+      fixtures.inputJpgWithCorruptHeader,
+      fixtures.inputWebP
+    ], function(err, results) {
+      if (err) throw err;
+      assert.strictEqual(4, results.length);
+      assert.strictEqual('jpeg', results[0].format);
+      assert.strictEqual(2725, results[0].width);
+      assert.strictEqual(2225, results[0].height);
+      assert.strictEqual('png', results[1].format);
+      assert.strictEqual(2048, results[1].width);
+      assert.strictEqual(1536, results[1].height);
+      assert.strictEqual(true, results[1].hasAlpha);
+      assert.strictEqual(true, results[2] instanceof Error);
+      if (sharp.format.webp.input.file) {
+        assert.strictEqual('webp', results[3].format);
+        assert.strictEqual(1024, results[3].width);
+      }
+      done();
+    });
+  });
+
+  it('Batch via Promise', function(done) {
+    sharp.metadataBatch([fixtures.inputJpg, fixtures.inputJpg]).then(function(results) {
+      assert.strictEqual(2, results.length);
+      assert.deepEqual(results[0], results[1]);
+      done();
+    });
+  });
+
+  it('Batch with invalid inputs', function() {
+    assert.throws(function() {
+      sharp.metadataBatch(fixtures.inputJpg);
+    });
+    assert.throws(function() {
+      sharp.metadataBatch([fixtures.inputJpg, 1]);
+    });
+  });
+
   it('File input with corrupt header fails gracefully', function(done) {
     sharp(fixtures.inputJpgWithCorruptHeader)
       .metadata(function(err) {
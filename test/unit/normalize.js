@@ -98,6 +98,93 @@ describe('Normalization', function () {
         });
     });
 
+    it('keeps the hue and saturation of rgb images', function (done) {
+      // Hue in degrees and saturation of each sufficiently bright, unclipped pixel
+      var hueAndSaturation = function (data, i) {
+        var r = data[i], g = data[i + 1], b = data[i + 2];
+        var max = Math.max(r, g, b), min = Math.min(r, g, b), range = max - min;
+        var hue = 0;
+        if (range > 0) {
+          if (max === r) {
+            hue = 60 * (((g - b) / range) % 6);
+          } else if (max === g) {
+            hue = 60 * ((b - r) / range + 2);
+          } else {
+            hue = 60 * ((r - g) / range + 4);
+          }
+        }
+        return [(hue + 360) % 360, range / max, range];
+      };
+      sharp(fixtures.inputJpgWithLowContrast)
+        .raw()
+        .toBuffer(function (err, original) {
+          if (err) throw err;
+          sharp(fixtures.inputJpgWithLowContrast)
+            .normalize()
+            .raw()
+            .toBuffer(function (err, normalized) {
+              if (err) throw err;
+              assert.strictEqual(original.length, normalized.length);
+              var hueDifference = 0, saturationDifference = 0, compared = 0, i;
+              for (i = 0; i < original.length; i += 3) {
+                var before = hueAndSaturation(original, i);
+                var after = hueAndSaturation(normalized, i);
+                // Saturated enough for hue to be meaningful
+                if (before[2] >= 16 && after[2] >= 16 && Math.max(normalized[i], normalized[i + 1], normalized[i + 2]) < 255) {
+                  var difference = Math.abs(before[0] - after[0]);
+                  hueDifference += Math.min(difference, 360 - difference);
+                  saturationDifference += Math.abs(before[1] - after[1]);
+                  compared++;
+                }
+              }
+              assert.strictEqual(true, compared > 0);
+              // Luminance alone is stretched, so only rounding changes hue and saturation
+              assert.strictEqual(true, hueDifference / compared < 2);
+              assert.strictEqual(true, saturationDifference / compared < 0.02);
+              return done();
+            });
+        });
+    });
+
+    it('clips the lower and upper percentiles', function (done) {
+      var countExtremes = function (data) {
+        var extremes = 0, i;
+        for (i = 0; i < data.length; i++) {
+          if (data[i] === 0 || data[i] === 255) {
+            extremes++;
+          }
+        }
+        return extremes;
+      };
+      sharp(fixtures.inputJpgWithLowContrast)
+        .normalize()
+        .raw()
+        .toBuffer(function (err, data) {
+          if (err) throw err;
+          sharp(fixtures.inputJpgWithLowContrast)
+            .normalize(5, 95)
+            .raw()
+            .toBuffer(function (err, clipped) {
+              if (err) throw err;
+              assert.strictEqual(data.length, clipped.length);
+              assert.strictEqual(true, countExtremes(clipped) > countExtremes(data));
+              return done();
+            });
+        });
+    });
+
+    it('rejects invalid percentiles', function () {
+      assert.throws(function () {
+        sharp().normalize(-1);
+      });
+      assert.throws(function () {
+        sharp().normalize(50, 40);
+      });
+      assert.throws(function () {
+        sharp().normalize(0, 101);
+      });
+    });
+
     it('returns a black image for images with only one color', function (done) {
       sharp(fixtures.inputPngWithOneColor)
         .normalize()
@@ -0,0 +1,97 @@
+'use strict';
+
+var assert = require('assert');
+
+var sharp = require('../../index');
+var fixtures = require('../fixtures');
+
+sharp.cache(0);
+
+describe('Pipeline', function() {
+
+  it('Buffer output from file input', function(done) {
+    var pipeline = sharp.pipeline({ resize: [320, 240], png: true });
+    pipeline.toBuffer(fixtures.inputJpg, function(err, data, info) {
+      if (err) throw err;
+      assert.strictEqual(true, data.length > 0);
+      assert.strictEqual(data.length, info.size);
+      assert.strictEqual('png', info.format);
+      assert.strictEqual(320, info.width);
+      assert.strictEqual(240, info.height);
+      pipeline.release();
+      done();
+    });
+  });
+
+  it('Reused for many inputs', function(done) {
+    var pipeline = sharp.pipeline({ resize: 160, webp: true, quality: 50 });
+    var inputs = [fixtures.inputJpg, fixtures.inputPng, fixtures.inputWebP];
+    var remaining = inputs.length;
+    inputs.forEach(function(input) {
+      pipeline.toBuffer(input, function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual('webp', info.format);
+        assert.strictEqual(160, info.width);
+        remaining--;
+        if (remaining === 0) {
+          pipeline.release();
+          done();
+        }
+      });
+    });
+  });
+
+  it('Matches the equivalent chain of methods', function(done) {
+    var input = require('fs').readFileSync(fixtures.inputJpg);
+    var pipeline = sharp.pipeline({ resize: [320, 240], crop: sharp.gravity.north, sharpen: true, jpeg: true });
+    pipeline.toBuffer(input).then(function(data) {
+      sharp(input).resize(320, 240).crop(sharp.gravity.north).sharpen().jpeg().toBuffer(function(err, expected) {
+        if (err) throw err;
+        assert.strictEqual(expected.toString('hex'), data.toString('hex'));
+        pipeline.release();
+        done();
+      });
+    });
+  });
+
+  it('File output', function(done) {
+    var pipeline = sharp.pipeline({ resize: [320, 240] });
+    pipeline.toFile(fixtures.inputJpg, fixtures.path('output.pipeline.jpg'), function(err, info) {
+      if (err) throw err;
+      assert.strictEqual('jpeg', info.format);
+      assert.strictEqual(320, info.width);
+      assert.strictEqual(240, info.height);
+      pipeline.release();
+      done();
+    });
+  });
+
+  it('Invalid operations', function() {
+    assert.throws(function() {
+      sharp.pipeline({ toFile: 'output.jpg' });
+    });
+    assert.throws(function() {
+      sharp.pipeline({ quality: 101 });
+    });
+  });
+
+  it('Invalid input', function() {
+    var pipeline = sharp.pipeline({ resize: 320 });
+    assert.throws(function() {
+      pipeline.toBuffer(1);
+    });
+    assert.throws(function() {
+      pipeline.toBuffer(new Buffer(0));
+    });
+    pipeline.release();
+  });
+
+  it('Cannot be used once released', function() {
+    var pipeline = sharp.pipeline({ resize: 320 });
+    pipeline.release();
+    assert.throws(function() {
+      pipeline.toBuffer(fixtures.inputJpg);
+    });
+  });
+
+});
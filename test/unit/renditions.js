@@ -0,0 +1,91 @@
+'use strict';
+
+var assert = require('assert');
+
+var sharp = require('../../index');
+var fixtures = require('../fixtures');
+
+sharp.cache(0);
+
+describe('Renditions', function() {
+
+  it('Many widths from one input, returned in requested order', function(done) {
+    sharp(fixtures.inputJpg).toBuffers([
+      { width: 320 },
+      { width: 1024 },
+      { width: 640 }
+    ], function(err, renditions) {
+      if (err) throw err;
+      assert.strictEqual(3, renditions.length);
+      [[320, 261], [1024, 836], [640, 522]].forEach(function(dimensions, index) {
+        var rendition = renditions[index];
+        assert.strictEqual(true, rendition.data.length > 0);
+        assert.strictEqual(rendition.data.length, rendition.info.size);
+        assert.strictEqual('jpeg', rendition.info.format);
+        assert.strictEqual(dimensions[0], rendition.info.width);
+        assert.strictEqual(dimensions[1], rendition.info.height);
+      });
+      done();
+    });
+  });
+
+  it('Mixed canvas and format', function(done) {
+    sharp(fixtures.inputJpg).toBuffers([
+      { width: 800, height: 600, canvas: 'max', format: 'png' },
+      { width: 200, height: 200, gravity: sharp.gravity.north, format: 'webp', quality: 50 },
+      { width: 200, height: 200, canvas: 'embed' }
+    ], function(err, renditions) {
+      if (err) throw err;
+      assert.strictEqual('png', renditions[0].info.format);
+      assert.strictEqual(735, renditions[0].info.width);
+      assert.strictEqual(600, renditions[0].info.height);
+      assert.strictEqual('webp', renditions[1].info.format);
+      assert.strictEqual(200, renditions[1].info.width);
+      assert.strictEqual(200, renditions[1].info.height);
+      assert.strictEqual('jpeg', renditions[2].info.format);
+      assert.strictEqual(200, renditions[2].info.width);
+      assert.strictEqual(200, renditions[2].info.height);
+      sharp(renditions[1].data).metadata(function(err, metadata) {
+        if (err) throw err;
+        assert.strictEqual('webp', metadata.format);
+        assert.strictEqual(200, metadata.width);
+        assert.strictEqual(200, metadata.height);
+        done();
+      });
+    });
+  });
+
+  it('Shared options apply to each rendition', function(done) {
+    sharp(fixtures.inputJpgWithExif).rotate().greyscale().toBuffers([
+      { width: 300 },
+      { width: 100, height: 100 }
+    ]).then(function(renditions) {
+      assert.strictEqual(300, renditions[0].info.width);
+      assert.strictEqual(225, renditions[0].info.height);
+      assert.strictEqual(100, renditions[1].info.width);
+      assert.strictEqual(100, renditions[1].info.height);
+      done();
+    }).catch(function(err) {
+      done(err);
+    });
+  });
+
+  it('Invalid renditions', function() {
+    assert.throws(function() {
+      sharp(fixtures.inputJpg).toBuffers([]);
+    });
+    assert.throws(function() {
+      sharp(fixtures.inputJpg).toBuffers([{ width: 'zoinks' }]);
+    });
+    assert.throws(function() {
+      sharp(fixtures.inputJpg).toBuffers([{ canvas: 'zoinks' }]);
+    });
+    assert.throws(function() {
+      sharp(fixtures.inputJpg).toBuffers([{ format: 'tiff' }]);
+    });
+    assert.throws(function() {
+      sharp(fixtures.inputJpg).tiff().toBuffers([{ width: 100 }]);
+    });
+  });
+
+});
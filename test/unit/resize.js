@@ -1,6 +1,7 @@
 'use strict';
 
 var assert = require('assert');
+var semver = require('semver');
 
 var sharp = require('../../index');
 var fixtures = require('../fixtures');
@@ -348,6 +349,75 @@ describe('Resize dimensions', function() {
     });
   });
   
+  if (sharp.format.webp.input.file && semver.gte(sharp.libvipsVersion(), '8.0.0')) {
+    it('Downscale WebP using shrink-on-load [libvips ' + sharp.libvipsVersion() + '>=8.0.0]', function(done) {
+      sharp(fixtures.inputWebP).resize(128).toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(true, data.length > 0);
+        assert.strictEqual('webp', info.format);
+        assert.strictEqual(128, info.width);
+        assert.strictEqual(96, info.height);
+        done();
+      });
+    });
+
+    it('Downscale WebP by a non power of two using shrink-on-load [libvips ' + sharp.libvipsVersion() + '>=8.0.0]', function(done) {
+      sharp(fixtures.inputWebP).resize(300, 200).toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(true, data.length > 0);
+        assert.strictEqual('webp', info.format);
+        assert.strictEqual(300, info.width);
+        assert.strictEqual(200, info.height);
+        done();
+      });
+    });
+
+    it('Downscale WebP using shrink-on-load keeps dimensions [libvips ' + sharp.libvipsVersion() + '>=8.0.0]', function(done) {
+      sharp(fixtures.inputWebP).resize(77, 77).max().toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(77, info.width);
+        assert.strictEqual(58, info.height);
+        sharp(fixtures.inputWebP).resize(77).toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(77, info.width);
+          assert.strictEqual(58, info.height);
+          done();
+        });
+      });
+    });
+  }
+
+  it('Shrink-on-load keeps the dimensions of a single output', function(done) {
+    // Dimensions as calculated from the input before shrink-on-load, which libjpeg rounds up
+    var expected = [
+      { resize: [101], width: 101, height: 82 },
+      { resize: [null, 83], width: 101, height: 83 },
+      { resize: [101, 83], width: 101, height: 83 },
+      { resize: [101, 101], canvas: 'max', width: 101, height: 82 },
+      { resize: [101, 101], canvas: 'min', width: 124, height: 101 },
+      { resize: [101, 101], canvas: 'embed', width: 101, height: 101 },
+      { resize: [101, 83], canvas: 'ignoreAspectRatio', width: 101, height: 83 }
+    ];
+    var check = function(index) {
+      if (index === expected.length) {
+        return done();
+      }
+      var pipeline = sharp(fixtures.inputJpg).timings();
+      pipeline.resize.apply(pipeline, expected[index].resize);
+      if (expected[index].canvas) {
+        pipeline[expected[index].canvas]();
+      }
+      pipeline.toBuffer(function(err, data, info) {
+        if (err) return done(err);
+        assert.strictEqual(true, info.timings.shrinkOnLoad > 1);
+        assert.strictEqual(expected[index].width, info.width);
+        assert.strictEqual(expected[index].height, info.height);
+        check(index + 1);
+      });
+    };
+    check(0);
+  });
+
   it('Identity transform, ignoring aspect ratio', function(done) {
     sharp(fixtures.inputJpg).ignoreAspectRatio().toBuffer(function(err, data, info) {
       if (err) throw err;
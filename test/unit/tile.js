@@ -6,6 +6,7 @@ var assert = require('assert');
 
 var async = require('async');
 var rimraf = require('rimraf');
+var semver = require('semver');
 
 var sharp = require('../../index');
 var fixtures = require('../fixtures');
@@ -47,6 +48,34 @@ var assertDeepZoomTiles = function(directory, expectedSize, expectedLevels, done
   }, done);
 };
 
+// Verifies data is a zip container in which every JPEG tile is stored without compression
+var assertZipStored = function(data) {
+  assert.strictEqual('504b0304', data.slice(0, 4).toString('hex'));
+  // Find the central directory from the end of central directory record, which ends the data
+  var end = data.length - 22;
+  while (end > 0 && data.readUInt32LE(end) !== 0x06054b50) {
+    end--;
+  }
+  assert.strictEqual(0x06054b50, data.readUInt32LE(end));
+  var entries = data.readUInt16LE(end + 10);
+  var entry = data.readUInt32LE(end + 16);
+  var tiles = 0;
+  for (var i = 0; i < entries; i++) {
+    assert.strictEqual(0x02014b50, data.readUInt32LE(entry));
+    var nameLength = data.readUInt16LE(entry + 28);
+    var name = data.toString('utf8', entry + 46, entry + 46 + nameLength);
+    // The local header of the entry records the compression method actually used
+    var local = data.readUInt32LE(entry + 42);
+    assert.strictEqual(0x04034b50, data.readUInt32LE(local));
+    if (/\.jpeg$/.test(name)) {
+      assert.strictEqual(0, data.readUInt16LE(local + 8));
+      tiles++;
+    }
+    entry += 46 + nameLength + data.readUInt16LE(entry + 30) + data.readUInt16LE(entry + 32);
+  }
+  assert.strictEqual(true, tiles > 0);
+};
+
 describe('Tile', function() {
 
   describe('Invalid tile values', function() {
@@ -173,6 +202,67 @@ describe('Tile', function() {
 
   });
 
+  describe('Single tile', function() {
+
+    it('Edge tile at the highest level', function(done) {
+      sharp(fixtures.inputJpg).extractTile(12, 10, 8).jpeg().toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual('jpeg', info.format);
+        assert.strictEqual(165, info.width);
+        assert.strictEqual(177, info.height);
+        done();
+      });
+    });
+
+    it('Tile with overlap at a lower level', function(done) {
+      sharp(fixtures.inputJpg).tile(512, 16).extractTile(11, 2, 0).jpeg().toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(355, info.width);
+        assert.strictEqual(528, info.height);
+        done();
+      });
+    });
+
+    it('Single pixel at level 0', function(done) {
+      sharp(fixtures.inputJpg).extractTile(0, 0, 0).png().toBuffer(function(err, data, info) {
+        if (err) throw err;
+        assert.strictEqual(1, info.width);
+        assert.strictEqual(1, info.height);
+        done();
+      });
+    });
+
+    it('Column outside level', function(done) {
+      sharp(fixtures.inputJpg).extractTile(12, 11, 0).jpeg().toBuffer(function(err) {
+        assert.strictEqual(true, err instanceof Error);
+        done();
+      });
+    });
+
+    it('Level beyond maximum', function(done) {
+      sharp(fixtures.inputJpg).extractTile(13, 0, 0).jpeg().toBuffer(function(err) {
+        assert.strictEqual(true, err instanceof Error);
+        done();
+      });
+    });
+
+    it('Invalid address', function() {
+      assert.throws(function() {
+        sharp().extractTile(1, -1, 0);
+      });
+      assert.throws(function() {
+        sharp().extractTile(1.5, 0, 0);
+      });
+    });
+
+    it('Cannot follow pre-resize extract', function() {
+      assert.throws(function() {
+        sharp().extract(0, 0, 10, 10).extractTile(1, 0, 0);
+      });
+    });
+
+  });
+
   if (sharp.format.dz.output.file) {
     describe('Deep Zoom output', function() {
 
@@ -198,6 +288,74 @@ describe('Tile', function() {
         });
       });
 
+      it('Single tile matches generated tile', function(done) {
+        var directory = fixtures.path('output.512_files');
+        sharp(fixtures.inputJpg).tile(512, 16).toFile(fixtures.path('output.512.dzi'), function(err) {
+          if (err) throw err;
+          sharp(path.join(directory, '11', '2_1.jpeg')).metadata(function(err, metadata) {
+            if (err) throw err;
+            sharp(fixtures.inputJpg).tile(512, 16).extractTile(11, 2, 1).jpeg().toBuffer(function(err, data, info) {
+              if (err) throw err;
+              assert.strictEqual(metadata.width, info.width);
+              assert.strictEqual(metadata.height, info.height);
+              done();
+            });
+          });
+        });
+      });
+
+      it('Zip container - file', function(done) {
+        var zip = fixtures.path('output.dz.zip');
+        rimraf(zip, function() {
+          sharp(fixtures.inputJpg).tile(512, 16).toFile(zip, function(err, info) {
+            if (err) throw err;
+            assert.strictEqual('dz', info.format);
+            assert.strictEqual(false, fs.existsSync(fixtures.path('output.dz_files')));
+            var data = fs.readFileSync(zip);
+            if (semver.gte(sharp.libvipsVersion(), '8.8.0')) {
+              assertZipStored(data);
+            } else {
+              // Earlier versions of libvips deflate tiles
+              assert.strictEqual('504b0304', data.slice(0, 4).toString('hex'));
+            }
+            done();
+          });
+        });
+      });
+
+      if (sharp.format.dz.output.buffer) {
+        var assertZip = function(data) {
+          if (semver.gte(sharp.libvipsVersion(), '8.8.0')) {
+            assertZipStored(data);
+          } else {
+            // Earlier versions of libvips deflate tiles
+            assert.strictEqual('504b0304', data.slice(0, 4).toString('hex'));
+          }
+        };
+
+        it('Zip container - Buffer', function(done) {
+          sharp(fixtures.inputJpg).tile(512, 16).dz().toBuffer(function(err, data, info) {
+            if (err) throw err;
+            assert.strictEqual('dz', info.format);
+            assert.strictEqual(data.length, info.size);
+            assertZip(data);
+            done();
+          });
+        });
+
+        it('Zip container - Stream', function(done) {
+          var chunks = [];
+          var readable = sharp(fixtures.inputJpg).toFormat('dz');
+          readable.on('data', function(chunk) {
+            chunks.push(chunk);
+          });
+          readable.on('end', function() {
+            assertZip(Buffer.concat(chunks));
+            done();
+          });
+        });
+      }
+
     });
   }
 
@@ -0,0 +1,72 @@
+'use strict';
+
+var assert = require('assert');
+
+var sharp = require('../../index');
+var fixtures = require('../fixtures');
+
+sharp.cache(0);
+
+describe('Timings', function() {
+
+  it('Not reported by default', function(done) {
+    sharp(fixtures.inputJpg).resize(320, 240).toBuffer(function(err, data, info) {
+      if (err) throw err;
+      assert.strictEqual(undefined, info.timings);
+      done();
+    });
+  });
+
+  it('JPEG with shrink-on-load', function(done) {
+    sharp(fixtures.inputJpg).resize(320, 240).timings().toBuffer(function(err, data, info) {
+      if (err) throw err;
+      assert.strictEqual('object', typeof info.timings);
+      ['queue', 'open', 'reload', 'build', 'render'].forEach(function(stage) {
+        assert.strictEqual('number', typeof info.timings[stage]);
+        assert.strictEqual(true, info.timings[stage] >= 0);
+      });
+      assert.strictEqual(2725, info.timings.inputWidth);
+      assert.strictEqual(2225, info.timings.inputHeight);
+      assert.strictEqual(8, info.timings.shrinkOnLoad);
+      assert.strictEqual(1, info.timings.xshrink);
+      assert.strictEqual(1, info.timings.yshrink);
+      done();
+    });
+  });
+
+  it('PNG without shrink-on-load', function(done) {
+    sharp(fixtures.inputPng).resize(320, 240).timings().toFile(fixtures.path('output.timings.png'), function(err, info) {
+      if (err) throw err;
+      assert.strictEqual(1, info.timings.shrinkOnLoad);
+      assert.strictEqual(true, info.timings.xshrink > 1);
+      assert.strictEqual(true, info.timings.yshrink > 1);
+      assert.strictEqual(true, info.timings.render > 0);
+      done();
+    });
+  });
+
+  it('Can be disabled', function(done) {
+    sharp(fixtures.inputJpg).resize(320, 240).timings().timings(false).toBuffer(function(err, data, info) {
+      if (err) throw err;
+      assert.strictEqual(undefined, info.timings);
+      done();
+    });
+  });
+
+  it('Reported for each rendition', function(done) {
+    sharp(fixtures.inputJpg).timings().toBuffers([
+      { width: 640, height: 480 },
+      { width: 160, height: 120 }
+    ], function(err, renditions) {
+      if (err) throw err;
+      assert.strictEqual(2, renditions.length);
+      renditions.forEach(function(rendition) {
+        assert.strictEqual('object', typeof rendition.info.timings);
+        assert.strictEqual(2725, rendition.info.timings.inputWidth);
+        assert.strictEqual(4, rendition.info.timings.shrinkOnLoad);
+      });
+      done();
+    });
+  });
+
+});
@@ -1,7 +1,9 @@
 'use strict';
 
+var fs = require('fs');
 var assert = require('assert');
 var sharp = require('../../index');
+var fixtures = require('../fixtures');
 
 var defaultConcurrency = sharp.concurrency();
 
@@ -24,6 +26,163 @@ describe('Utilities', function() {
       assert.strictEqual(50, cache.memory);
       assert.strictEqual(500, cache.items);
     });
+    it('Intermediates disabled by default', function() {
+      var intermediates = sharp.cache().intermediates;
+      assert.strictEqual(0, intermediates.memory);
+      assert.strictEqual(0, intermediates.items);
+    });
+    it('Intermediates reused at the same or a smaller size', function(done) {
+      sharp.cache(null, null, 64);
+      var resize = function(width, height, callback) {
+        sharp(fixtures.inputJpg).resize(width, height).toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(width, info.width);
+          assert.strictEqual(height, info.height);
+          callback(sharp.cache().intermediates);
+        });
+      };
+      resize(320, 240, function(intermediates) {
+        // Decoded with a shrink-on-load factor of 8
+        assert.strictEqual(0, intermediates.hits);
+        assert.strictEqual(1, intermediates.misses);
+        assert.strictEqual(1, intermediates.items);
+        resize(160, 120, function(intermediates) {
+          assert.strictEqual(1, intermediates.hits);
+          resize(640, 480, function(intermediates) {
+            // Requires a smaller shrink-on-load factor of 4
+            assert.strictEqual(1, intermediates.hits);
+            assert.strictEqual(2, intermediates.misses);
+            assert.strictEqual(2, intermediates.items);
+            resize(320, 240, function(intermediates) {
+              assert.strictEqual(2, intermediates.hits);
+              intermediates = sharp.cache(null, null, 0).intermediates;
+              assert.strictEqual(0, intermediates.memory);
+              assert.strictEqual(0, intermediates.items);
+              assert.strictEqual(0, intermediates.current);
+              done();
+            });
+          });
+        });
+      });
+    });
+    it('Resources shared between tasks', function(done) {
+      var resize = function(callback) {
+        sharp(fixtures.inputJpg).resize(320, 240).interpolateWith(sharp.interpolator.bicubic).blur().sharpen()
+          .toBuffer(function(err) {
+            if (err) throw err;
+            callback(sharp.cache().resources);
+          });
+      };
+      resize(function(first) {
+        assert.strictEqual(true, first.interpolators >= 1);
+        assert.strictEqual(2, first.matrices);
+        resize(function(second) {
+          assert.strictEqual(first.interpolators, second.interpolators);
+          assert.strictEqual(first.kernels, second.kernels);
+          assert.strictEqual(2, second.matrices);
+          assert.strictEqual(true, second.hits > first.hits);
+          assert.strictEqual(first.misses, second.misses);
+          done();
+        });
+      });
+    });
+    it('Outputs disabled by default', function() {
+      var outputs = sharp.cache().outputs;
+      assert.strictEqual(0, outputs.memory);
+      assert.strictEqual(0, outputs.items);
+    });
+    it('Outputs reused with the same input and options', function(done) {
+      sharp.cache(null, null, null, 16);
+      sharp(fixtures.inputJpg).resize(320, 240).webp().toBuffer(function(err, first, firstInfo) {
+        if (err) throw err;
+        var outputs = sharp.cache().outputs;
+        assert.strictEqual(0, outputs.hits);
+        assert.strictEqual(1, outputs.misses);
+        assert.strictEqual(1, outputs.items);
+        sharp(fixtures.inputJpg).resize(320, 240).webp().toBuffer(function(err, second, secondInfo) {
+          if (err) throw err;
+          assert.strictEqual(1, sharp.cache().outputs.hits);
+          assert.strictEqual(first.toString('hex'), second.toString('hex'));
+          assert.deepEqual(firstInfo, secondInfo);
+          // Different options miss
+          sharp(fixtures.inputJpg).resize(320, 240).webp().quality(50).toBuffer(function(err) {
+            if (err) throw err;
+            outputs = sharp.cache().outputs;
+            assert.strictEqual(1, outputs.hits);
+            assert.strictEqual(2, outputs.misses);
+            outputs = sharp.cache(null, null, null, 0).outputs;
+            assert.strictEqual(0, outputs.items);
+            done();
+          });
+        });
+      });
+    });
+    it('Outputs not reused after a file is rewritten with the same size', function(done) {
+      var rewritten = fixtures.path('output.rewritten.png');
+      // Uncompressed PNG images of the same dimensions and channels have the same size
+      var original = sharp(fixtures.inputJpg).resize(32, 32).png().compressionLevel(0);
+      original.toBuffer(function(err, first) {
+        if (err) throw err;
+        original.flip().toBuffer(function(err, second) {
+          if (err) throw err;
+          assert.strictEqual(first.length, second.length);
+          var hits = sharp.cache(null, null, null, 16).outputs.hits;
+          fs.writeFileSync(rewritten, first);
+          sharp(rewritten).raw().toBuffer(function(err, firstPixels) {
+            if (err) throw err;
+            // Rewrite within the same second
+            fs.writeFileSync(rewritten, second);
+            sharp(rewritten).raw().toBuffer(function(err, secondPixels) {
+              if (err) throw err;
+              assert.strictEqual(hits, sharp.cache(null, null, null, 0).outputs.hits);
+              assert.notStrictEqual(firstPixels.toString('hex'), secondPixels.toString('hex'));
+              done();
+            });
+          });
+        });
+      });
+    });
+  });
+
+  describe('SIMD', function() {
+    it('Reports the instruction set in use', function() {
+      assert.strictEqual(true, ['avx2', 'sse4.1', 'scalar', 'none'].indexOf(sharp.simd()) !== -1);
+    });
+    it('Can be disabled and enabled', function() {
+      assert.strictEqual('none', sharp.simd(false));
+      assert.notStrictEqual('none', sharp.simd(true));
+      assert.strictEqual(sharp.simd(), sharp.simd('spoons'));
+    });
+    it('Identical output to libvips for 1 to 4 channels', function(done) {
+      var inputs = [
+        fixtures.inputJpgWithGammaHoliness,
+        fixtures.inputPngWithGreyAlpha,
+        fixtures.inputJpg,
+        fixtures.inputPngWithTransparency
+      ];
+      var render = function(input, callback) {
+        // Mild blur and sharpen, with a Gaussian pre-blur before the affine reduction
+        sharp(input).resize(123, 97).blur().sharpen().png().toBuffer(function(err, data) {
+          if (err) throw err;
+          callback(data.toString('hex'));
+        });
+      };
+      var compare = function(index) {
+        if (index === inputs.length) {
+          sharp.simd(true);
+          return done();
+        }
+        sharp.simd(true);
+        render(inputs[index], function(accelerated) {
+          sharp.simd(false);
+          render(inputs[index], function(reference) {
+            assert.strictEqual(reference, accelerated);
+            compare(index + 1);
+          });
+        });
+      };
+      compare(0);
+    });
   });
 
   describe('Concurrency', function() {
@@ -42,11 +201,169 @@ describe('Utilities', function() {
     });
   });
 
+  describe('Pool', function() {
+    it('Can be resized', function() {
+      var defaultPool = sharp.pool();
+      assert.strictEqual(2, sharp.pool(2).threads);
+      assert.strictEqual(2, sharp.pool().threads);
+      assert.strictEqual(defaultPool.threads, sharp.pool(defaultPool.threads).threads);
+    });
+    it('Can order by shortest job first', function() {
+      assert.strictEqual(false, sharp.pool().shortestJobFirst);
+      assert.strictEqual(true, sharp.pool(null, true).shortestJobFirst);
+      assert.strictEqual(false, sharp.pool(null, false).shortestJobFirst);
+    });
+    it('Ignores invalid values', function() {
+      var defaultPool = sharp.pool();
+      sharp.pool(0, 'spoons');
+      assert.deepEqual(defaultPool, sharp.pool());
+    });
+    it('Runs high priority tasks first', function(done) {
+      var defaultPool = sharp.pool();
+      var finished = [];
+      sharp.pool(1);
+      sharp(fixtures.inputJpg).resize(320, 240).priority('low').toBuffer(function(err) {
+        if (err) throw err;
+        finished.push('low');
+      });
+      sharp(fixtures.inputJpg).resize(320, 240).toBuffer(function(err) {
+        if (err) throw err;
+        finished.push('normal');
+      });
+      sharp(fixtures.inputJpg).resize(320, 240).priority('high').toBuffer(function(err) {
+        if (err) throw err;
+        // The low priority task, queued first, may already have started on the only thread
+        assert.strictEqual(-1, finished.indexOf('normal'));
+        sharp.pool(defaultPool.threads);
+        done();
+      });
+    });
+    it('Invalid priority', function() {
+      assert.throws(function() {
+        sharp().priority('urgent');
+      });
+    });
+  });
+
+  describe('Admission', function() {
+    it('Can set memory and queue limits', function() {
+      assert.deepEqual({ memory: 0, queue: 0 }, sharp.admission());
+      assert.deepEqual({ memory: 64, queue: 0 }, sharp.admission(64));
+      assert.deepEqual({ memory: 64, queue: 10 }, sharp.admission(null, 10));
+      assert.deepEqual({ memory: 0, queue: 0 }, sharp.admission(0, 0));
+    });
+    it('Ignores invalid values', function() {
+      sharp.admission(-1, 'spoons');
+      assert.deepEqual({ memory: 0, queue: 0 }, sharp.admission());
+    });
+    it('Runs tasks that exceed the memory budget one at a time', function(done) {
+      sharp.admission(1);
+      // The header of file input is not read before admission, so use a Buffer
+      var input = fs.readFileSync(fixtures.inputJpg);
+      var remaining = 3;
+      for (var i = 0; i < 3; i++) {
+        sharp(input).resize(320, 240).toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(320, info.width);
+          assert.strictEqual(true, sharp.counters().process <= 1);
+          remaining--;
+          if (remaining === 0) {
+            assert.strictEqual(0, sharp.counters().memory);
+            sharp.admission(0);
+            done();
+          }
+        });
+      }
+    });
+    it('Admits tasks with file input once their header is read', function(done) {
+      sharp.admission(1);
+      var remaining = 3;
+      for (var i = 0; i < 3; i++) {
+        sharp(fixtures.inputJpg).resize(320, 240).toBuffer(function(err, data, info) {
+          if (err) throw err;
+          assert.strictEqual(320, info.width);
+          remaining--;
+          if (remaining === 0) {
+            // All memory admitted on the worker has been released
+            assert.strictEqual(0, sharp.counters().memory);
+            sharp.admission(0);
+            done();
+          }
+        });
+      }
+    });
+    it('Rejects tasks when the queue is full', function(done) {
+      var defaultPool = sharp.pool();
+      var rejected = sharp.counters().rejected;
+      sharp.pool(1);
+      sharp.admission(null, 1);
+      // The first task may start on the only thread, leaving the second to fill the queue
+      sharp(fixtures.inputJpg).resize(320, 240).toBuffer(function(err) {
+        if (err) throw err;
+      });
+      sharp(fixtures.inputJpg).resize(320, 240).toBuffer(function(err) {
+        if (err) throw err;
+        sharp.pool(defaultPool.threads);
+        done();
+      });
+      sharp(fixtures.inputJpg).resize(320, 240).toBuffer(function(err) {
+        assert.strictEqual(true, err instanceof Error);
+        assert.strictEqual('EAGAIN', err.code);
+        assert.strictEqual(rejected + 1, sharp.counters().rejected);
+        sharp.admission(null, 0);
+      });
+    });
+  });
+
   describe('Counters', function() {
     it('Have zero value at rest', function() {
       var counters = sharp.counters();
       assert.strictEqual(0, counters.queue);
       assert.strictEqual(0, counters.process);
+      assert.strictEqual(0, counters.memory);
+    });
+  });
+
+  describe('Metrics', function() {
+    it('Can be reset', function() {
+      sharp.metrics(true);
+      var metrics = sharp.metrics();
+      assert.strictEqual(0, metrics.latency.total.count);
+      assert.deepEqual({}, metrics.input);
+      assert.deepEqual({}, metrics.output);
+      assert.strictEqual(0, metrics.shrinkOnLoad.eligible);
+    });
+    it('Count tasks by input and output format', function(done) {
+      sharp.metrics(true);
+      sharp(fixtures.inputJpg).resize(320, 240).png().toBuffer(function(err, data) {
+        if (err) throw err;
+        var metrics = sharp.metrics(true);
+        assert.strictEqual(1, metrics.latency.total.count);
+        assert.strictEqual(metrics.latency.bounds.length + 1, metrics.latency.total.counts.length);
+        assert.strictEqual(1, metrics.latency.total.counts.reduce(function(a, b) { return a + b; }));
+        assert.strictEqual(1, metrics.input.jpeg.count);
+        assert.strictEqual(0, metrics.input.jpeg.errors);
+        assert.strictEqual(true, metrics.input.jpeg.bytes > 0);
+        assert.strictEqual(2725 * 2225, metrics.input.jpeg.pixels);
+        assert.strictEqual(1, metrics.output.png.count);
+        assert.strictEqual(data.length, metrics.output.png.bytes);
+        assert.strictEqual(320 * 240, metrics.output.png.pixels);
+        assert.deepEqual({ eligible: 1, hits: 1, rate: 1 }, metrics.shrinkOnLoad);
+        assert.strictEqual(0, sharp.metrics().latency.total.count);
+        done();
+      });
+    });
+    it('Count errors', function(done) {
+      sharp.metrics(true);
+      sharp(new Buffer([0x1, 0x2, 0x3, 0x4])).toBuffer(function(err) {
+        assert.strictEqual(true, err instanceof Error);
+        var metrics = sharp.metrics(true);
+        assert.strictEqual(1, metrics.latency.total.count);
+        assert.strictEqual(1, metrics.input.unknown.count);
+        assert.strictEqual(1, metrics.input.unknown.errors);
+        assert.deepEqual({}, metrics.output);
+        done();
+      });
     });
   });
 